@@ -0,0 +1,210 @@
+#include "AssetLoader.h"
+
+static double getMillisecondsSince(Uint64 startTime) {
+	return (double)(SDL_GetPerformanceCounter() - startTime) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+AssetLoader::AssetLoader() {
+	mutex = SDL_CreateMutex();
+	jobsChanged = SDL_CreateCond();
+}
+
+AssetLoader::~AssetLoader() {
+	stop();
+
+	SDL_DestroyCond(jobsChanged);
+	SDL_DestroyMutex(mutex);
+}
+
+void AssetLoader::start(int workerCount) {
+	SDL_LockMutex(mutex);
+	stopping = false;
+	SDL_UnlockMutex(mutex);
+
+	for (int i = 0; i < workerCount; i++) {
+		string threadName = "Asset loader " + to_string(i);
+		SDL_Thread* worker = SDL_CreateThread(workerThread, threadName.c_str(), this);
+		if (worker == NULL) {
+			SDL_Log("Couldn't start an asset loading thread, jobs will be finished on the main thread instead. SDL Error: %s", SDL_GetError());
+			break;
+		}
+		workers.push_back(worker);
+	}
+}
+
+void AssetLoader::stop() {
+	SDL_LockMutex(mutex);
+	stopping = true;
+	SDL_CondBroadcast(jobsChanged);
+	SDL_UnlockMutex(mutex);
+
+	for (SDL_Thread* worker : workers)
+		SDL_WaitThread(worker, NULL);
+	workers.clear();
+
+	// No one is going to finish these now
+	for (Job* job : unfinishedJobs)
+		delete job;
+	unfinishedJobs.clear();
+	queuedJobs.clear();
+}
+
+int AssetLoader::queueJob(string name, function<bool()> workerStage, function<bool()> mainThreadStage) {
+	Job* job = new Job();
+	job->id = nextJobID++;
+	job->name = name;
+	job->workerStage = workerStage;
+	job->mainThreadStage = mainThreadStage;
+	job->state = JobState::QUEUED;
+	job->workerStageResult = false;
+	job->queuedTime = SDL_GetPerformanceCounter();
+	job->workerStageMilliseconds = 0;
+
+	SDL_LockMutex(mutex);
+	queuedJobs.push_back(job);
+	unfinishedJobs.push_back(job);
+	SDL_CondSignal(jobsChanged);
+	SDL_UnlockMutex(mutex);
+
+	return job->id;
+}
+
+void AssetLoader::update(double maxMilliseconds) {
+	Uint64 startTime = SDL_GetPerformanceCounter();
+
+	while (getMillisecondsSince(startTime) < maxMilliseconds) {
+		// Find the oldest job that a worker has finished with
+		Job* finishedJob = NULL;
+		SDL_LockMutex(mutex);
+		for (Job* job : unfinishedJobs) {
+			if (job->state == JobState::WORKER_STAGE_DONE) {
+				finishedJob = job;
+				break;
+			}
+		}
+		SDL_UnlockMutex(mutex);
+
+		if (finishedJob == NULL) return;
+		completeJob(finishedJob);
+	}
+}
+
+bool AssetLoader::finishJob(int jobID) {
+	auto finishedJob = finishedJobs.find(jobID);
+	if (finishedJob != finishedJobs.end())
+		return finishedJob->second;
+
+	SDL_LockMutex(mutex);
+
+	Job* job = NULL;
+	for (Job* unfinishedJob : unfinishedJobs) {
+		if (unfinishedJob->id == jobID) {
+			job = unfinishedJob;
+			break;
+		}
+	}
+
+	if (job == NULL) {
+		SDL_UnlockMutex(mutex);
+		return false;
+	}
+
+	// If no worker has started the job then it's quicker to just do it here than to wait for the jobs in front of it
+	if (job->state == JobState::QUEUED) {
+		for (auto queuedJob = queuedJobs.begin(); queuedJob != queuedJobs.end(); queuedJob++) {
+			if (*queuedJob == job) {
+				queuedJobs.erase(queuedJob);
+				break;
+			}
+		}
+		job->state = JobState::RUNNING;
+		SDL_UnlockMutex(mutex);
+
+		Uint64 workerStageStartTime = SDL_GetPerformanceCounter();
+		bool result = job->workerStage ? job->workerStage() : true;
+		double workerStageMilliseconds = getMillisecondsSince(workerStageStartTime);
+
+		SDL_LockMutex(mutex);
+		job->workerStageResult = result;
+		job->workerStageMilliseconds = workerStageMilliseconds;
+		job->state = JobState::WORKER_STAGE_DONE;
+	}
+
+	while (job->state != JobState::WORKER_STAGE_DONE)
+		SDL_CondWait(jobsChanged, mutex);
+	SDL_UnlockMutex(mutex);
+
+	return completeJob(job);
+}
+
+bool AssetLoader::isJobFinished(int jobID) {
+	return finishedJobs.count(jobID) > 0;
+}
+
+int AssetLoader::getDefaultWorkerCount() {
+	return max(1, min(4, SDL_GetCPUCount() - 1));
+}
+
+int AssetLoader::workerThread(void* data) {
+	AssetLoader* loader = (AssetLoader*)data;
+	PROFILE_THREAD_NAME("Asset loader");
+
+	SDL_LockMutex(loader->mutex);
+	while (true) {
+		while (!loader->stopping && loader->queuedJobs.empty())
+			SDL_CondWait(loader->jobsChanged, loader->mutex);
+		if (loader->stopping) break;
+
+		Job* job = loader->queuedJobs.front();
+		loader->queuedJobs.pop_front();
+		job->state = JobState::RUNNING;
+		SDL_UnlockMutex(loader->mutex);
+
+		bool result = true;
+		Uint64 workerStageStartTime = SDL_GetPerformanceCounter();
+		if (job->workerStage) {
+			PROFILE_ZONE("Asset worker stage");
+			result = job->workerStage();
+		}
+		double workerStageMilliseconds = getMillisecondsSince(workerStageStartTime);
+
+		SDL_LockMutex(loader->mutex);
+		job->workerStageResult = result;
+		job->workerStageMilliseconds = workerStageMilliseconds;
+		job->state = JobState::WORKER_STAGE_DONE;
+		// finishJob might be waiting for this job
+		SDL_CondBroadcast(loader->jobsChanged);
+	}
+	SDL_UnlockMutex(loader->mutex);
+
+	return 0;
+}
+
+bool AssetLoader::completeJob(Job* job) {
+	PROFILE_FUNCTION();
+
+	bool result = job->workerStageResult;
+	Uint64 mainThreadStageStartTime = SDL_GetPerformanceCounter();
+	if (result && job->mainThreadStage)
+		result = job->mainThreadStage();
+
+	// The total includes the time spent waiting for a worker and for the main thread to get to it, so it shows how long the asset actually took to show up
+	if (result)
+		SDL_Log("Loaded %s in %.2fms (%.2fms loading, %.2fms on the main thread)", job->name.c_str(), getMillisecondsSince(job->queuedTime), job->workerStageMilliseconds, getMillisecondsSince(mainThreadStageStartTime));
+	else
+		SDL_Log("Couldn't load %s", job->name.c_str());
+
+	SDL_LockMutex(mutex);
+	for (auto unfinishedJob = unfinishedJobs.begin(); unfinishedJob != unfinishedJobs.end(); unfinishedJob++) {
+		if (*unfinishedJob == job) {
+			unfinishedJobs.erase(unfinishedJob);
+			break;
+		}
+	}
+	SDL_UnlockMutex(mutex);
+
+	finishedJobs.insert(make_pair(job->id, result));
+	delete job;
+
+	return result;
+}
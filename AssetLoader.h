@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+
+#include <SDL.h>
+
+#include "Profiler.h"
+
+using namespace std;
+
+// The asset loader does the slow parts of loading (reading files, decoding images and parsing maps) on worker threads so the game doesn't freeze
+// while it happens. Each job has two stages. The worker stage runs on a worker thread and can't touch the renderer. The main thread stage runs
+// on the main thread once the worker stage is done, and is where textures get made. Either stage can be empty
+class AssetLoader
+{
+public:
+	AssetLoader();
+	~AssetLoader();
+
+	// Starts the worker threads. Jobs can be queued before this, they just won't run until the workers start
+	void start(int workerCount);
+	// Waits for the workers to finish the jobs they are running and stops them. Jobs that haven't started are thrown away
+	void stop();
+
+	// Adds a job to the end of the queue and returns its ID. The stages return false if they fail, and the main thread stage isn't run if the worker stage failed
+	int queueJob(string name, function<bool()> workerStage, function<bool()> mainThreadStage);
+	// Runs the main thread stage of the jobs that the workers have finished. This is called every frame, and stops starting new main thread stages
+	// once it has used up the time it was given (in milliseconds) so that a lot of jobs finishing at once doesn't cause a hitch
+	void update(double maxMilliseconds);
+	// Finishes a job right now. If a worker hasn't picked it up yet then the worker stage is run on this thread, otherwise this waits for the
+	// worker. Returns false if the job failed or there isn't a job with that ID
+	bool finishJob(int jobID);
+	// Returns true once both stages of the job have been run
+	bool isJobFinished(int jobID);
+	// Picks how many workers to start based on how many cores there are. One core is left for the main thread
+	static int getDefaultWorkerCount();
+
+private:
+	enum class JobState {
+		QUEUED,
+		RUNNING,
+		WORKER_STAGE_DONE
+	};
+
+	struct Job {
+		int id;
+		string name;
+		function<bool()> workerStage;
+		function<bool()> mainThreadStage;
+		JobState state;
+		bool workerStageResult;
+
+		// For reporting how long each asset took to load
+		Uint64 queuedTime;
+		double workerStageMilliseconds;
+	};
+
+	// Everything below here is shared with the workers, so it can only be touched while the mutex is locked
+	SDL_mutex* mutex = NULL;
+	// Signalled when a job is queued (for the workers) and when a worker stage finishes (for finishJob)
+	SDL_cond* jobsChanged = NULL;
+	// Jobs that are waiting for a worker
+	deque<Job*> queuedJobs;
+	// Every job that hasn't been completely finished, in the order they were queued
+	vector<Job*> unfinishedJobs;
+	bool stopping = false;
+
+	vector<SDL_Thread*> workers;
+	int nextJobID = 1;
+	// The results of the jobs that have been finished. Only used by the main thread
+	unordered_map<int, bool> finishedJobs;
+
+	static int workerThread(void* loader);
+	// Runs the main thread stage of a job whose worker stage is done and forgets about the job
+	bool completeJob(Job* job);
+};
@@ -16,6 +16,8 @@ AudioHandler::~AudioHandler() {
 }
 
 bool AudioHandler::loadMusic() {
+	PROFILE_FUNCTION();
+
 	unordered_map<int, vector<string>> musicFilenames = { {0, { "resources/sounds/menus.mp3", "resources/sounds/ex1.mp3" }}, {1, { "resources/sounds/background.mp3" }} };
 
 	// Looping through every filename of every screen/music type
@@ -34,6 +36,8 @@ bool AudioHandler::loadMusic() {
 }
 
 void AudioHandler::playMusic(int musicType) {
+	PROFILE_FUNCTION();
+
 	// Play music can be called to change the music. For example, user clicks the play button and this is called to change the music from menu to background
 	// Thats why we need to compare the supplied music type, because if it is different then the game is changing states.
 	// This means we need to restart the the audio loop for the current state.
@@ -46,6 +50,8 @@ void AudioHandler::playMusic(int musicType) {
 }
 
 void AudioHandler::checkForTrackEnd() {
+	PROFILE_FUNCTION();
+
 	// The only time this function will detect a stop in the music is when the track ends and should move on to the next one
 	if (!Mix_PlayingMusic()) {
 		// Go to the next track, but make sure we don't go to far
@@ -59,11 +65,15 @@ void AudioHandler::checkForTrackEnd() {
 }
 
 void AudioHandler::mute() {
+	PROFILE_FUNCTION();
+
 	currentMusicIndex = 0;
 	Mix_HaltMusic();
 }
 
 void AudioHandler::unmute(int musicType, bool paused) {
+	PROFILE_FUNCTION();
+
 	currentMusicType = musicType;
 	playMusic(currentMusicType);
 
@@ -6,6 +6,8 @@
 #include <vector>
 #include <string>
 
+#include "Profiler.h"
+
 using namespace std;
 
 class AudioHandler
@@ -18,114 +18,114 @@ void CollisionListener::clear() {
 
 	// These 4 need to be reset because they are per-level based
 	movingPlatforms.clear();
-	buttons.clear();
+	fill(buttons.begin(), buttons.end(), 0);
 	entityFixturesUnderfoot.clear();
 	playerBody = NULL;
 }
 
-void CollisionListener::BeginContact(b2Contact* contact) {
-	// Store the type of fixture. There are 8 possible values defined in Box2dOverrides.h Need to do a cast to (size_t) because of issues with
-	// the building in android studio. See https://stackoverflow.com/a/27044460/10018988
-	int fixtureAData = (int)(size_t)contact->GetFixtureA()->GetUserData();
-	int fixtureBData = (int)(size_t)contact->GetFixtureB()->GetUserData();
-
-	// We need to know what moving platforms the player is on so we can add to the velocity. This stops the player from sliding off
-	if (fixtureAData == PLAYER_SENSOR && fixtureBData == MOVING_PLATFORM)
-		movingPlatforms.insert(contact->GetFixtureB()->GetBody());
-	else if (fixtureAData == MOVING_PLATFORM && fixtureBData == PLAYER_SENSOR)
-		movingPlatforms.insert(contact->GetFixtureA()->GetBody());
-
-	// The basics, checks for collisions with ladders and things that kill the player
-	if (fixtureAData == LADDER && fixtureBData == PLAYER_BODY || fixtureBData == LADDER && fixtureAData == PLAYER_BODY)
-		playerLadderContacts++;
-	else if (fixtureAData == DANGEROUS_TILE && fixtureBData == PLAYER_BODY || fixtureBData == DANGEROUS_TILE && fixtureAData == PLAYER_BODY)
-		playerDangerContacts++;
-
-	// Level entrances on the selection level
-	else if (fixtureAData / 1000000 == FINISH_POINT && fixtureBData == PLAYER_BODY) {
-		playerFinishPointContacts++;
-		// Store the finish point that the player is currently touching. This will be used to decide which level they go to
-		levelEntranceNum = fixtureAData - FINISH_POINT * 1000000;
-	}
-	else if (fixtureBData / 1000000 == FINISH_POINT && fixtureAData == PLAYER_BODY) {
-		playerFinishPointContacts++;
-		// Store the finish point that the player is currently touching. This will be used to decide which level they go to
-		levelEntranceNum = fixtureBData - FINISH_POINT * 1000000;
-	}
+static bool contactFilteringEnabled = true;
 
-	// As long as it's not the player's foot sensor, if something touches a button we need to know so we can activate the platform it's linked to
-	else if (fixtureAData != PLAYER_SENSOR && fixtureBData / 1000000 == BUTTON)
-		buttons[fixtureBData - BUTTON * 1000000]++;
-	else if (fixtureAData / 1000000 == BUTTON && fixtureBData != PLAYER_SENSOR)
-		buttons[fixtureAData - BUTTON * 1000000]++;
-
-	// Finally, we need to know when the player is on the ground. This stops them from jumping in mid air and flying around
-	if (fixtureAData == PLAYER_SENSOR && fixtureBData != LADDER && fixtureBData != DANGEROUS_TILE && fixtureBData < 100000 ||
-		fixtureBData == PLAYER_SENSOR && fixtureAData != LADDER && fixtureAData != DANGEROUS_TILE && fixtureAData < 100000) {
-		playerGroundContacts++;
-
-		// If fixture A is an entity, then we need to add it to the entity list. This will then be used to apply a kickback to it when the player walks
-		if (fixtureAData == ENTITY)
-			entityFixturesUnderfoot.insert(contact->GetFixtureA());
-		// Same thing if the entity is fixture B instead
-		else if (fixtureBData == ENTITY)
-			entityFixturesUnderfoot.insert(contact->GetFixtureB());
+b2Filter getFixtureFilter(FixtureKind kind) {
+	b2Filter filter;
+	if (contactFilteringEnabled) {
+		filter.categoryBits = (uint16)(1 << (int)kind);
+		filter.maskBits = fixtureMaskTable.masks[(int)kind];
 	}
+	return filter;
+}
+
+void setContactFiltering(bool enabled) {
+	contactFilteringEnabled = enabled;
+}
+
+// Fixtures without a tag count as ground
+static const FixtureTag untaggedFixture = { FixtureKind::GROUND, -1, -1 };
 
-	// If the player is on a ladder then they shouldn't have gravity
-	if (playerLadderContacts > 0 && playerBody != NULL)
-		playerBody->SetGravityScale(0);
+static const FixtureTag* getFixtureTag(b2Fixture* fixture) {
+	const FixtureTag* tag = (const FixtureTag*)fixture->GetUserData();
+	return tag != NULL ? tag : &untaggedFixture;
+}
+
+void CollisionListener::BeginContact(b2Contact* contact) {
+	updateContact(contact, true);
 }
 
 void CollisionListener::EndContact(b2Contact* contact) {
-	// Store the type of fixture. There are 8 possible values defined in Box2dOverrides.h Need to do a cast to (size_t) because of issues with
-	// the building in android studio. See https://stackoverflow.com/a/27044460/10018988
-	int fixtureAData = (int)(size_t)contact->GetFixtureA()->GetUserData();
-	int fixtureBData = (int)(size_t)contact->GetFixtureB()->GetUserData();
-
-	// We need to know what moving platforms the player is on so we can add to the velocity. This stops the player from sliding off
-	if (fixtureAData == PLAYER_SENSOR && fixtureBData == MOVING_PLATFORM)
-		movingPlatforms.erase(contact->GetFixtureB()->GetBody());
-	else if (fixtureAData == MOVING_PLATFORM && fixtureBData == PLAYER_SENSOR)
-		movingPlatforms.erase(contact->GetFixtureA()->GetBody());
-
-	// All of the basics, checks for collisions with ladders, things that kill the player and the end of the level
-	if (fixtureAData == LADDER && fixtureBData == PLAYER_BODY || fixtureBData == LADDER && fixtureAData == PLAYER_BODY)
-		playerLadderContacts--;
-	else if (fixtureAData == DANGEROUS_TILE && fixtureBData == PLAYER_BODY || fixtureBData == DANGEROUS_TILE && fixtureAData == PLAYER_BODY)
-		playerDangerContacts--;
-	else if (fixtureAData == FINISH_POINT && fixtureBData == PLAYER_BODY || fixtureBData == FINISH_POINT && fixtureAData == PLAYER_BODY)
-		playerFinishPointContacts--;
-
-	// Level entrances on the selection level
-	else if (fixtureAData / 1000000 == FINISH_POINT && fixtureBData == PLAYER_BODY || fixtureBData / 1000000 == FINISH_POINT && fixtureAData == PLAYER_BODY) {
-		playerFinishPointContacts--;
-		// Since the player is no longer on a level entrance, we can reset the variable
-		levelEntranceNum = -1;
-	}
+	updateContact(contact, false);
+}
 
-	// As long as it's not the player's foot sensor, if something touches a button we need to know so we can activate the platform it's linked to
-	else if (fixtureAData != PLAYER_SENSOR && fixtureBData / 1000000 == BUTTON)
-		buttons[fixtureBData - BUTTON * 1000000]--;
-	else if (fixtureAData / 1000000 == BUTTON && fixtureBData != PLAYER_SENSOR)
-		buttons[fixtureAData - BUTTON * 1000000]--;
-
-	// Finally, we need to know when the player is on the ground. This stops them from jumping in mid air and flying around
-	if (fixtureAData == PLAYER_SENSOR && fixtureBData != LADDER && fixtureBData != DANGEROUS_TILE && fixtureBData < 100000 ||
-		fixtureBData == PLAYER_SENSOR && fixtureAData != LADDER && fixtureAData != DANGEROUS_TILE && fixtureAData < 100000) {
-		playerGroundContacts--;
-
-		// If fixture A is an entity, then we need to add it to the entity list. This will then be used to apply a kickback to it when the player walks
-		if (fixtureAData == ENTITY)
-			entityFixturesUnderfoot.erase(contact->GetFixtureA());
-		// Same thing if the entity is fixture B instead
-		else if (fixtureBData == ENTITY)
-			entityFixturesUnderfoot.erase(contact->GetFixtureB());
+void CollisionListener::updateContact(b2Contact* contact, bool touching) {
+	b2Fixture* fixtureA = contact->GetFixtureA();
+	b2Fixture* fixtureB = contact->GetFixtureB();
+	const FixtureTag* tagA = getFixtureTag(fixtureA);
+	const FixtureTag* tagB = getFixtureTag(fixtureB);
+
+	const ContactDispatch& dispatch = contactDispatchTable.entries[(int)tagA->kind][(int)tagB->kind];
+	if (dispatch.handler == ContactHandler::NONE) return;
+
+	// Put the fixtures in the same order as the rule, so the handlers only need to deal with one order
+	if (dispatch.swapped) {
+		swap(fixtureA, fixtureB);
+		swap(tagA, tagB);
 	}
 
-	// If the player is no longer on a ladder then they should have the normal gravity
-	if (playerLadderContacts < 1 && playerBody != NULL)
-		playerBody->SetGravityScale(1);
+	int change = touching ? 1 : -1;
+
+	switch (dispatch.handler) {
+	case ContactHandler::PLAYER_ON_LADDER:
+		playerLadderContacts += change;
+
+		// The player shouldn't have gravity while they are on a ladder
+		if (playerBody != NULL) {
+			if (touching && playerLadderContacts > 0)
+				playerBody->SetGravityScale(0);
+			else if (!touching && playerLadderContacts < 1)
+				playerBody->SetGravityScale(1);
+		}
+		break;
+
+	case ContactHandler::PLAYER_IN_DANGER:
+		playerDangerContacts += change;
+		break;
+
+	case ContactHandler::PLAYER_AT_FINISH:
+		playerFinishPointContacts += change;
+		// Store the finish point that the player is currently touching. This will be used to decide which level they go to
+		levelEntranceNum = touching ? tagB->linkedID : -1;
+		break;
+
+	case ContactHandler::FEET_ON_GROUND:
+		// We need to know when the player is on the ground. This stops them from jumping in mid air and flying around
+		playerGroundContacts += change;
+		break;
+
+	case ContactHandler::FEET_ON_MOVING_PLATFORM:
+		// We need to know what moving platforms the player is on so we can add to the velocity. This stops the player from sliding off
+		if (touching)
+			movingPlatforms.insert(fixtureB->GetBody());
+		else
+			movingPlatforms.erase(fixtureB->GetBody());
+		playerGroundContacts += change;
+		break;
+
+	case ContactHandler::FEET_ON_ENTITY:
+		// The entities the player is standing on get a kickback when the player walks
+		if (touching)
+			entityFixturesUnderfoot.insert(fixtureB);
+		else
+			entityFixturesUnderfoot.erase(fixtureB);
+		playerGroundContacts += change;
+		break;
+
+	case ContactHandler::BUTTON_PRESSED:
+		// If something touches a button we need to know so we can activate the platform it's linked to
+		if (tagA->linkedID >= 0 && tagA->linkedID < (int)buttons.size())
+			buttons[tagA->linkedID] += change;
+		break;
+
+	default:
+		break;
+	}
 }
 
 
@@ -135,13 +135,19 @@ void CollisionListener::EndContact(b2Contact* contact) {
 
 Box2dDraw::Box2dDraw() {}
 
-Box2dDraw::Box2dDraw(SDL_Renderer* ren, int screenHeight, int tileSize) {
+Box2dDraw::Box2dDraw(SDL_Renderer* ren, int screenWidth, int screenHeight, int tileSize) {
 	renderer = ren;
+	SCREEN_WIDTH = screenWidth;
 	SCREEN_HEIGHT = screenHeight;
 	TILE_SIZE = tileSize;
 	camXOffset = 0;
 	camYOffset = 0;
 
+	for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++) {
+		float angle = 2.0f * b2_pi * i / DEBUG_CIRCLE_SEGMENTS;
+		unitCircle[i] = b2Vec2(cosf(angle), sinf(angle));
+	}
+
 	srand(SDL_GetTicks());
 }
 
@@ -150,87 +156,153 @@ void Box2dDraw::updateCameraOffset(float x, float y) {
 	camYOffset = y;
 }
 
-void Box2dDraw::DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
+void Box2dDraw::drawWorld(b2World* world) {
+	// Turn the screen into meters. The y axis is flipped because box2d's y goes up and the screen's y goes down
+	viewport.lowerBound = b2Vec2(camXOffset / TILE_SIZE, -camYOffset / TILE_SIZE);
+	viewport.upperBound = b2Vec2((camXOffset + SCREEN_WIDTH) / TILE_SIZE, (SCREEN_HEIGHT - camYOffset) / TILE_SIZE);
+
+	if (GetFlags() & e_shapeBit) {
+		drawnFixtures.clear();
+		world->QueryAABB(this, viewport);
+	}
+
+	flush();
+}
+
+void Box2dDraw::flush() {
+	// Everything is drawn in the same colour, so it only needs to be set once
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 
-	for (int i = 0; i < vertexCount - 1; i++) {
-		SDL_RenderDrawLine(renderer, vertices[i].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[i].y * TILE_SIZE) - camYOffset, vertices[i + 1].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[i + 1].y * TILE_SIZE) - camYOffset);
+	for (int i = 0; i < outlineStarts.size(); i++) {
+		int outlineEnd = i + 1 < outlineStarts.size() ? outlineStarts[i + 1] : (int)outlinePoints.size();
+		SDL_RenderDrawLinesF(renderer, &outlinePoints[outlineStarts[i]], outlineEnd - outlineStarts[i]);
 	}
-	SDL_RenderDrawLine(renderer, vertices[vertexCount - 1].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[vertexCount - 1].y * TILE_SIZE) - camYOffset, vertices[0].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[0].y * TILE_SIZE) - camYOffset);
+
+	if (!points.empty())
+		SDL_RenderDrawPointsF(renderer, points.data(), (int)points.size());
+
+	// Clearing keeps the memory so we aren't allocating every frame
+	outlinePoints.clear();
+	outlineStarts.clear();
+	points.clear();
 }
 
-void Box2dDraw::DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
-	for (int i = 0; i < vertexCount - 1; i++) {
-		SDL_RenderDrawLine(renderer, vertices[i].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[i].y * TILE_SIZE) - camYOffset, vertices[i + 1].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[i + 1].y * TILE_SIZE) - camYOffset);
+bool Box2dDraw::ReportFixture(b2Fixture* fixture) {
+	if (drawnFixtures.insert(fixture).second)
+		drawFixture(fixture);
+
+	// Keep going so we find all of the fixtures
+	return true;
+}
+
+void Box2dDraw::drawFixture(b2Fixture* fixture) {
+	const b2Transform& transform = fixture->GetBody()->GetTransform();
+
+	switch (fixture->GetType()) {
+	case b2Shape::e_circle: {
+		b2CircleShape* circle = (b2CircleShape*)fixture->GetShape();
+		addCircle(b2Mul(transform, circle->m_p), circle->m_radius);
+		break;
 	}
-	SDL_RenderDrawLine(renderer, vertices[vertexCount - 1].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[vertexCount - 1].y * TILE_SIZE) - camYOffset, vertices[0].x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (vertices[0].y * TILE_SIZE) - camYOffset);
 
-	/*Sint16* xVertices = new Sint16[vertexCount];
-	Sint16* yVertices = new Sint16[vertexCount];
+	case b2Shape::e_edge: {
+		b2EdgeShape* edge = (b2EdgeShape*)fixture->GetShape();
+		b2Vec2 vertices[2] = { b2Mul(transform, edge->m_vertex1), b2Mul(transform, edge->m_vertex2) };
+		addOutline(vertices, 2, false);
+		break;
+	}
+
+	case b2Shape::e_chain: {
+		// A chain can go around a whole level, so only the edges that are on the screen are drawn. An edge that is drawn carries on the outline of the
+		// edge before it, so a run of visible edges is still one outline
+		b2ChainShape* chain = (b2ChainShape*)fixture->GetShape();
+		bool continuingOutline = false;
+		for (int i = 0; i < chain->m_count - 1; i++) {
+			b2Vec2 vertex1 = b2Mul(transform, chain->m_vertices[i]);
+			b2Vec2 vertex2 = b2Mul(transform, chain->m_vertices[i + 1]);
+
+			b2AABB edgeBounds;
+			edgeBounds.lowerBound = b2Min(vertex1, vertex2);
+			edgeBounds.upperBound = b2Max(vertex1, vertex2);
+			if (!b2TestOverlap(edgeBounds, viewport)) {
+				continuingOutline = false;
+				continue;
+			}
+
+			if (!continuingOutline) {
+				outlineStarts.push_back((int)outlinePoints.size());
+				outlinePoints.push_back(toScreen(vertex1));
+			}
+			outlinePoints.push_back(toScreen(vertex2));
+			continuingOutline = true;
+		}
+		break;
+	}
 
-	for (int i = 0; i < vertexCount; i++) {
-		xVertices[i] = vertices[i].x;
-		yVertices[i] = vertices[i].y;
+	case b2Shape::e_polygon: {
+		b2PolygonShape* polygon = (b2PolygonShape*)fixture->GetShape();
+		b2Vec2 vertices[b2_maxPolygonVertices];
+		for (int i = 0; i < polygon->m_count; i++)
+			vertices[i] = b2Mul(transform, polygon->m_vertices[i]);
+		addOutline(vertices, polygon->m_count, true);
+		break;
 	}
 
-	aapolygonRGBA(renderer, xVertices, yVertices, vertexCount, color.r, color.g, color.b, color.a);*/
+	default:
+		break;
+	}
 }
 
-void Box2dDraw::DrawCircle(const b2Vec2& center, float radius, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
-	DrawPoint(center, radius, color);
+SDL_FPoint Box2dDraw::toScreen(const b2Vec2& point) {
+	return { point.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (point.y * TILE_SIZE) - camYOffset };
 }
 
-void Box2dDraw::DrawSolidCircle(const b2Vec2& center, float radius, const b2Vec2& axis, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
-	//DrawPoint(center, radius, color);
-	renderCircle(center, radius, 60);
+void Box2dDraw::addOutline(const b2Vec2* vertices, int vertexCount, bool closed) {
+	if (vertexCount < 2) return;
+
+	outlineStarts.push_back((int)outlinePoints.size());
+	for (int i = 0; i < vertexCount; i++)
+		outlinePoints.push_back(toScreen(vertices[i]));
+	if (closed)
+		outlinePoints.push_back(toScreen(vertices[0]));
 }
 
-void Box2dDraw::DrawSegment(const b2Vec2& p1, const b2Vec2& p2, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
-	SDL_RenderDrawLine(renderer, p1.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (p1.y * TILE_SIZE) - camYOffset, p2.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (p2.y * TILE_SIZE) - camYOffset);
+void Box2dDraw::addCircle(const b2Vec2& center, float radius) {
+	outlineStarts.push_back((int)outlinePoints.size());
+	for (int i = 0; i < DEBUG_CIRCLE_SEGMENTS; i++)
+		outlinePoints.push_back(toScreen(center + radius * unitCircle[i]));
+	outlinePoints.push_back(toScreen(center + radius * unitCircle[0]));
 }
 
-void Box2dDraw::DrawTransform(const b2Transform& xf) {
-	//std::cout << "Drawing transform\n";
-	//SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+// These are called by b2World::DebugDraw. drawWorld doesn't use them, but they add to the same batch so that they still work if something else calls them. They are all drawn in the
+// same colour, so the colour Box2D asks for is ignored
+
+void Box2dDraw::DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color&) {
+	addOutline(vertices, vertexCount, true);
 }
 
-void Box2dDraw::DrawPoint(const b2Vec2& p, float size, const b2Color& color) {
-	//SDL_SetRenderDrawColor(renderer, rand() % 256, rand() % 256, rand() % 256, color.a);
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, color.a);
-	SDL_RenderDrawPoint(renderer, p.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (p.y * TILE_SIZE) - camYOffset);
+void Box2dDraw::DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color&) {
+	addOutline(vertices, vertexCount, true);
 }
 
-void Box2dDraw::renderCircle(const b2Vec2& center, float radius, unsigned int sides)
-{
-	const double _2PI = 3.1415926535898;
+void Box2dDraw::DrawCircle(const b2Vec2& center, float radius, const b2Color&) {
+	addCircle(center, radius);
+}
 
-	if (sides == 0)
-	{
-		sides = _2PI * radius / 2;
-	}
+void Box2dDraw::DrawSolidCircle(const b2Vec2& center, float radius, const b2Vec2& axis, const b2Color&) {
+	addCircle(center, radius);
+}
 
-	float d_a = _2PI / sides, angle = d_a;
-
-	b2Vec2 start, end;
-	end.x = radius;
-	end.y = 0.0f;
-	end = end + center;
-	for (int i = 0; i != sides; i++)
-	{
-		start = end;
-		end.x = cos(angle) * radius;
-		end.y = sin(angle) * radius;
-		end = end + center;
-		angle += d_a;
-		SDL_RenderDrawLine(renderer, start.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (start.y * TILE_SIZE) - camYOffset, end.x * TILE_SIZE - camXOffset, SCREEN_HEIGHT - (end.y * TILE_SIZE) - camYOffset);
-	}
-}
\ No newline at end of file
+void Box2dDraw::DrawSegment(const b2Vec2& p1, const b2Vec2& p2, const b2Color&) {
+	b2Vec2 vertices[2] = { p1, p2 };
+	addOutline(vertices, 2, false);
+}
+
+void Box2dDraw::DrawTransform(const b2Transform& xf) {
+	//std::cout << "Drawing transform\n";
+	//SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+}
+
+void Box2dDraw::DrawPoint(const b2Vec2& p, float size, const b2Color&) {
+	points.push_back(toScreen(p));
+}
@@ -7,18 +7,161 @@
 #include <vector>
 #include <unordered_map>
 #include <set>
+#include <unordered_set>
 
-#define PLAYER_BODY 1
-#define PLAYER_SENSOR 2
-#define DANGEROUS_TILE 3
-#define LADDER 4
-#define FINISH_POINT 5
-#define MOVING_PLATFORM 6
-#define BUTTON 7
-#define ENTITY 8
+#include "SmallSet.h"
+
+// How many straight lines make up a debug drawn circle
+#define DEBUG_CIRCLE_SEGMENTS 32
 
 using namespace std;
 
+// What a fixture is, so the collision listener knows what touched what
+enum class FixtureKind : Uint8 {
+	// Normal ground. Fixtures without a tag are ground too
+	GROUND,
+	PLAYER_BODY,
+	// The sensor under the player's feet that checks if they are on the ground
+	PLAYER_SENSOR,
+	DANGEROUS_TILE,
+	LADDER,
+	FINISH_POINT,
+	MOVING_PLATFORM,
+	BUTTON,
+	ENTITY,
+	// The bits that fly out of the player when they die
+	PARTICLE,
+	// Not a real kind, this is just how many kinds there are. New kinds go above it
+	KIND_COUNT
+};
+
+// Every fixture's user data points at one of these. The level keeps all of the tags for its fixtures in one array that doesn't change while the
+// level is loaded, so the pointers stay valid for as long as the fixtures are around. The IDs have their own field, so they can be any size and the
+// collision listener doesn't have to unpack anything
+struct FixtureTag {
+	FixtureKind kind;
+	// The index of the moving platform a button starts, the level a finish point goes to, or the ID of a moving platform or entity. -1 if there isn't one
+	int linkedID;
+	// The index of the spawn record that the fixture was made from, or -1 if it didn't come from the level
+	int objectIndex;
+};
+
+// What the collision listener does when two kinds of fixture touch
+enum class ContactHandler : Uint8 {
+	NONE,
+	PLAYER_ON_LADDER,
+	PLAYER_IN_DANGER,
+	PLAYER_AT_FINISH,
+	// The player's foot sensor is on something it can stand on
+	FEET_ON_GROUND,
+	FEET_ON_MOVING_PLATFORM,
+	FEET_ON_ENTITY,
+	BUTTON_PRESSED
+};
+
+// One entry of the collision matrix. The first kind is always the one the handler is about (the player, their feet or the button), and the
+// handler gets the fixtures in that order no matter which way round Box2D has them
+struct ContactRule {
+	FixtureKind first;
+	FixtureKind second;
+	ContactHandler handler;
+};
+
+// Every pair of fixture kinds that the listener cares about. Pairs that aren't in here are ignored, so a new kind of fixture only needs an entry for
+// each kind it does something with
+constexpr ContactRule contactRules[] = {
+	{ FixtureKind::PLAYER_BODY, FixtureKind::LADDER, ContactHandler::PLAYER_ON_LADDER },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::DANGEROUS_TILE, ContactHandler::PLAYER_IN_DANGER },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::FINISH_POINT, ContactHandler::PLAYER_AT_FINISH },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::GROUND, ContactHandler::FEET_ON_GROUND },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::MOVING_PLATFORM, ContactHandler::FEET_ON_MOVING_PLATFORM },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::ENTITY, ContactHandler::FEET_ON_ENTITY },
+	// Anything but the player's feet can hold a button down
+	{ FixtureKind::BUTTON, FixtureKind::PLAYER_BODY, ContactHandler::BUTTON_PRESSED },
+	{ FixtureKind::BUTTON, FixtureKind::ENTITY, ContactHandler::BUTTON_PRESSED },
+	{ FixtureKind::BUTTON, FixtureKind::PARTICLE, ContactHandler::BUTTON_PRESSED }
+};
+
+// The collision matrix turned into a table that can be looked up with the kinds of the two fixtures in the order Box2D gives them. Swapped is true if
+// the fixtures need to be swapped to be in the same order as the rule
+struct ContactDispatch {
+	ContactHandler handler;
+	bool swapped;
+};
+
+struct ContactDispatchTable {
+	ContactDispatch entries[(int)FixtureKind::KIND_COUNT][(int)FixtureKind::KIND_COUNT];
+};
+
+constexpr ContactDispatchTable buildContactDispatchTable() {
+	ContactDispatchTable table = {};
+	for (const ContactRule& rule : contactRules) {
+		table.entries[(int)rule.first][(int)rule.second] = { rule.handler, false };
+		table.entries[(int)rule.second][(int)rule.first] = { rule.handler, true };
+	}
+	return table;
+}
+
+// This is worked out by the compiler, so there's nothing to set up when the game starts
+constexpr ContactDispatchTable contactDispatchTable = buildContactDispatchTable();
+
+// The pairs of fixture kinds that Box2D makes contacts for. That is every pair that bumps into each other (two solid fixtures where at least one of
+// them is dynamic) and every pair that the collision listener wants to know about. Every other pair is filtered out in the broadphase, so it never
+// gets as far as the narrow phase or the listener. The pairs that are left out are sensors touching things that don't care about them, like entities
+// going past ladders, finish points or the player's feet going through a button, so filtering them doesn't change how anything moves.
+// A pair that is in the collision matrix above needs to be in here too
+constexpr FixtureKind collidingKinds[][2] = {
+	// The player
+	{ FixtureKind::PLAYER_BODY, FixtureKind::GROUND },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::DANGEROUS_TILE },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::MOVING_PLATFORM },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::ENTITY },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::PARTICLE },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::LADDER },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::FINISH_POINT },
+	{ FixtureKind::PLAYER_BODY, FixtureKind::BUTTON },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::GROUND },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::MOVING_PLATFORM },
+	{ FixtureKind::PLAYER_SENSOR, FixtureKind::ENTITY },
+	// Entities. Dangerous tiles are solid, so things other than the player can sit on them
+	{ FixtureKind::ENTITY, FixtureKind::GROUND },
+	{ FixtureKind::ENTITY, FixtureKind::DANGEROUS_TILE },
+	{ FixtureKind::ENTITY, FixtureKind::MOVING_PLATFORM },
+	{ FixtureKind::ENTITY, FixtureKind::ENTITY },
+	{ FixtureKind::ENTITY, FixtureKind::PARTICLE },
+	{ FixtureKind::ENTITY, FixtureKind::BUTTON },
+	// Death particles pile up on each other and on everything solid
+	{ FixtureKind::PARTICLE, FixtureKind::GROUND },
+	{ FixtureKind::PARTICLE, FixtureKind::DANGEROUS_TILE },
+	{ FixtureKind::PARTICLE, FixtureKind::MOVING_PLATFORM },
+	{ FixtureKind::PARTICLE, FixtureKind::PARTICLE },
+	{ FixtureKind::PARTICLE, FixtureKind::BUTTON }
+};
+
+// Each kind gets its own category bit, and Box2D only has 16 of them
+static_assert((int)FixtureKind::KIND_COUNT <= 16, "There are too many fixture kinds for Box2D's collision filtering");
+
+struct FixtureMaskTable {
+	uint16 masks[(int)FixtureKind::KIND_COUNT];
+};
+
+// Works out which categories each kind collides with. Both kinds of a pair get each other's bit, so the masks always agree
+constexpr FixtureMaskTable buildFixtureMaskTable() {
+	FixtureMaskTable table = {};
+	for (const auto& pair : collidingKinds) {
+		table.masks[(int)pair[0]] |= (uint16)(1 << (int)pair[1]);
+		table.masks[(int)pair[1]] |= (uint16)(1 << (int)pair[0]);
+	}
+	return table;
+}
+
+constexpr FixtureMaskTable fixtureMaskTable = buildFixtureMaskTable();
+
+// The filter that a fixture of this kind should be made with. If filtering has been turned off (with --no-contact-filter) this is Box2D's default
+// filter, where everything collides with everything, so the contact counts can be compared
+b2Filter getFixtureFilter(FixtureKind kind);
+void setContactFiltering(bool enabled);
+
 class CollisionListener : public b2ContactListener {
 public:
 	CollisionListener();
@@ -45,27 +188,39 @@ public:
 	// the user presses enter to join the level. If the player isn't currently touching a level entrance on the level selection level, this will be -1
 	int levelEntranceNum;
 
-	// For moving platforms
-	set<b2Body*> movingPlatforms;
+	// For moving platforms. The player can only stand on a few things at once, so these fit in the sets without allocating
+	SmallSet<b2Body*, 4> movingPlatforms;
 
 	// This will hold all of the entities that the player is standing on. It is needed because we want to apply impulses to the entities when the player moves.
 	// This will also hold the ground fixtures but they won't react to forces anyway
-	set<b2Fixture*> entityFixturesUnderfoot;
+	SmallSet<b2Fixture*, 8> entityFixturesUnderfoot;
 
-	// This map will be passed to the level for use in deciding if a platform should be moved or not. The first element is the ID of the platform that
-	// the button controls. The second element is the number of contacts currently on that button.
-	unordered_map<int, int> buttons;
+	// This will be passed to the level for use in deciding if a platform should be moved or not. It has a counter for every moving platform in the
+	// level, in the same order as the level's platforms, which holds the number of contacts currently on that platform's button. It is sized when
+	// the level starts, and clear() zeroes it instead of emptying it, so contacts never allocate
+	vector<int> buttons;
 
 private:
 	b2Body* playerBody;
+
+	// Begin and end contact do the same things in opposite directions. Touching is true when the contact begins
+	void updateContact(b2Contact* contact, bool touching);
 };
 
-class Box2dDraw : public b2Draw {
+// Draws the hitboxes for debugging. Instead of drawing every line straight away, the lines are collected over the whole frame and drawn
+// together in flush(), so the draw colour is only set once and each outline is a single draw call. drawWorld() only draws the fixtures
+// that are on the screen, so this doesn't get slower as the level gets bigger
+class Box2dDraw : public b2Draw, public b2QueryCallback {
 public:
 	Box2dDraw();
-	Box2dDraw(SDL_Renderer* ren, int screenHeight, int tileSize);
+	Box2dDraw(SDL_Renderer* ren, int screenWidth, int screenHeight, int tileSize);
 	void updateCameraOffset(float x, float y);
 
+	// Draws the shapes of all of the fixtures that are on the screen. Use this instead of b2World::DebugDraw, which draws every fixture in the world
+	void drawWorld(b2World* world);
+	// Draws all of the lines and points that have been collected
+	void flush();
+
 	void DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color);
 	void DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color);
 	void DrawCircle(const b2Vec2& center, float radius, const b2Color& color);
@@ -74,12 +229,36 @@ public:
 	void DrawTransform(const b2Transform& xf);
 	void DrawPoint(const b2Vec2& p, float size, const b2Color& color);
 
+	// Called by b2World::QueryAABB for every fixture that might be on the screen
+	bool ReportFixture(b2Fixture* fixture);
+
 private:
 	SDL_Renderer* renderer;
+	int SCREEN_WIDTH;
 	int SCREEN_HEIGHT;
 	int TILE_SIZE;
 	float camXOffset;
 	float camYOffset;
 
-	void renderCircle(const b2Vec2& center, float radius, unsigned int sides);
+	// The part of the world that is on the screen, in meters
+	b2AABB viewport;
+
+	// All of the outlines for this frame. Each outline is a list of points in screen coordinates, and outlineStarts holds where each one begins in
+	// outlinePoints. Closed outlines repeat their first point at the end
+	vector<SDL_FPoint> outlinePoints;
+	vector<int> outlineStarts;
+	vector<SDL_FPoint> points;
+
+	// Chain shapes have a broadphase proxy for every edge, so QueryAABB can report the same fixture lots of times. We only want to draw it once
+	unordered_set<b2Fixture*> drawnFixtures;
+
+	// The points around a circle with a radius of 1, worked out once so we don't need to do any trig when drawing circles
+	b2Vec2 unitCircle[DEBUG_CIRCLE_SEGMENTS];
+
+	SDL_FPoint toScreen(const b2Vec2& point);
+	// Adds an outline that goes through the given points (in meters)
+	void addOutline(const b2Vec2* vertices, int vertexCount, bool closed);
+	void addCircle(const b2Vec2& center, float radius);
+	// Draws a fixture's shape where its body is
+	void drawFixture(b2Fixture* fixture);
 };
\ No newline at end of file
@@ -0,0 +1,436 @@
+#include "CollisionGeometry.h"
+
+// All of the merging is done in Tiled's pixels, but with y going up like it does in Box2D, so a counter clockwise outline has the solid part on its left
+struct MergePoint {
+	double x;
+	double y;
+};
+
+// An edge of one of the polygons being merged. The polygon is the index of the polygon the edge came from
+struct MergeEdge {
+	MergePoint start;
+	MergePoint end;
+	int polygon;
+};
+
+struct MergePolygon {
+	vector<MergePoint> points;
+	// The bounding box, so polygons that are nowhere near each other can be skipped quickly
+	double left, right, bottom, top;
+};
+
+// Points closer than this (in pixels) are the same point
+#define MERGE_EPSILON 0.001
+// Outline vertices closer together than this are joined. Box2D needs the vertices of a chain to be further apart than b2_linearSlop (0.005m, which is
+// 0.16px), so this leaves some room
+#define MERGE_MIN_EDGE_LENGTH 0.25
+// The fragment endpoints are snapped to a grid this fine (in fractions of a pixel) when they are joined into outlines
+#define MERGE_SNAP_SCALE 1024.0
+
+static MergePoint subtract(MergePoint a, MergePoint b) { return { a.x - b.x, a.y - b.y }; }
+static double cross(MergePoint a, MergePoint b) { return a.x * b.y - a.y * b.x; }
+static double dot(MergePoint a, MergePoint b) { return a.x * b.x + a.y * b.y; }
+static double length(MergePoint a) { return sqrt(dot(a, a)); }
+
+static double getSignedArea(const vector<MergePoint>& points) {
+	double area = 0;
+	for (int i = 0; i < points.size(); i++) {
+		const MergePoint& a = points[i];
+		const MergePoint& b = points[(i + 1) % points.size()];
+		area += a.x * b.y - b.x * a.y;
+	}
+	return area / 2;
+}
+
+static bool isPointOnSegment(MergePoint point, MergePoint start, MergePoint end) {
+	MergePoint segment = subtract(end, start);
+	double segmentLengthSquared = dot(segment, segment);
+	if (segmentLengthSquared < MERGE_EPSILON * MERGE_EPSILON)
+		return length(subtract(point, start)) < MERGE_EPSILON;
+
+	double t = dot(subtract(point, start), segment) / segmentLengthSquared;
+	if (t < -MERGE_EPSILON || t > 1 + MERGE_EPSILON) return false;
+
+	MergePoint closest = { start.x + segment.x * t, start.y + segment.y * t };
+	return length(subtract(point, closest)) < MERGE_EPSILON;
+}
+
+// Only gives the right answer for points that aren't on the outline, which is checked first
+static bool isPointInPolygon(MergePoint point, const MergePolygon& polygon) {
+	bool inside = false;
+	const vector<MergePoint>& points = polygon.points;
+	for (int i = 0, j = (int)points.size() - 1; i < points.size(); j = i++) {
+		if ((points[i].y > point.y) != (points[j].y > point.y) &&
+			point.x < (points[j].x - points[i].x) * (point.y - points[i].y) / (points[j].y - points[i].y) + points[i].x)
+			inside = !inside;
+	}
+	return inside;
+}
+
+// Returns 1 if the point is on an edge of the polygon going the same way as the direction, -1 if it's on an edge going the opposite way
+// and 0 if it isn't on an edge that is parallel to the direction
+static int getBoundaryDirection(MergePoint point, MergePoint direction, const MergePolygon& polygon) {
+	const vector<MergePoint>& points = polygon.points;
+	for (int i = 0; i < points.size(); i++) {
+		MergePoint start = points[i];
+		MergePoint end = points[(i + 1) % points.size()];
+		if (!isPointOnSegment(point, start, end)) continue;
+
+		MergePoint edge = subtract(end, start);
+		if (fabs(cross(direction, edge)) > MERGE_EPSILON * length(direction) * length(edge)) continue;
+
+		return dot(direction, edge) > 0 ? 1 : -1;
+	}
+	return 0;
+}
+
+static bool doBoundsOverlap(const MergePolygon& a, const MergePolygon& b) {
+	return a.left <= b.right + MERGE_EPSILON && b.left <= a.right + MERGE_EPSILON && a.bottom <= b.top + MERGE_EPSILON && b.bottom <= a.top + MERGE_EPSILON;
+}
+
+// Adds the places (as a fraction of the way along the first edge) where the second edge crosses or touches it
+static void findSplitPoints(MergePoint start, MergePoint end, MergePoint otherStart, MergePoint otherEnd, vector<double>* splits) {
+	MergePoint edge = subtract(end, start);
+	MergePoint otherEdge = subtract(otherEnd, otherStart);
+	double denominator = cross(edge, otherEdge);
+	MergePoint startToOther = subtract(otherStart, start);
+
+	// The edges aren't parallel, so they cross at one point (if they are long enough)
+	if (fabs(denominator) > MERGE_EPSILON * length(edge) * length(otherEdge)) {
+		double t = cross(startToOther, otherEdge) / denominator;
+		double u = cross(startToOther, edge) / denominator;
+		double tolerance = MERGE_EPSILON / length(edge);
+		double otherTolerance = MERGE_EPSILON / length(otherEdge);
+		if (t > tolerance && t < 1 - tolerance && u >= -otherTolerance && u <= 1 + otherTolerance)
+			splits->push_back(t);
+		return;
+	}
+
+	// The edges are parallel. If they are on the same line then the ends of the other edge split this one
+	if (fabs(cross(startToOther, edge)) > MERGE_EPSILON * length(edge)) return;
+
+	double edgeLengthSquared = dot(edge, edge);
+	double tolerance = MERGE_EPSILON / length(edge);
+	for (MergePoint point : { otherStart, otherEnd }) {
+		double t = dot(subtract(point, start), edge) / edgeLengthSquared;
+		if (t > tolerance && t < 1 - tolerance)
+			splits->push_back(t);
+	}
+}
+
+// Takes out vertices that are too close to the one before them and vertices in the middle of a straight line
+static void simplifyOutline(vector<MergePoint>* outline) {
+	bool changed = true;
+	while (changed && outline->size() >= 3) {
+		changed = false;
+		for (int i = 0; i < outline->size() && outline->size() >= 3; i++) {
+			MergePoint previous = (*outline)[(i + outline->size() - 1) % outline->size()];
+			MergePoint current = (*outline)[i];
+			MergePoint next = (*outline)[(i + 1) % outline->size()];
+
+			MergePoint incoming = subtract(current, previous);
+			MergePoint outgoing = subtract(next, current);
+			bool tooClose = length(incoming) < MERGE_MIN_EDGE_LENGTH;
+			bool straight = fabs(cross(incoming, outgoing)) < MERGE_EPSILON * length(incoming) * length(outgoing) && dot(incoming, outgoing) > 0;
+
+			if (tooClose || straight) {
+				outline->erase(outline->begin() + i);
+				changed = true;
+				i--;
+			}
+		}
+	}
+}
+
+// Finds the polygons whose bounding boxes overlap each polygon. The polygons are sorted by their left side, so each one only has to be checked against
+// the polygons that start before it ends instead of against every other polygon. Levels made out of tiles can have thousands of them
+static vector<vector<int>> findNeighbours(const vector<MergePolygon>& polygons) {
+	vector<int> order(polygons.size());
+	for (int i = 0; i < order.size(); i++)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&](int a, int b) { return polygons[a].left < polygons[b].left; });
+
+	vector<vector<int>> neighbours(polygons.size());
+	for (int first = 0; first < order.size(); first++) {
+		const MergePolygon& polygon = polygons[order[first]];
+		for (int second = first + 1; second < order.size() && polygons[order[second]].left <= polygon.right + MERGE_EPSILON; second++) {
+			if (!doBoundsOverlap(polygon, polygons[order[second]])) continue;
+
+			neighbours[order[first]].push_back(order[second]);
+			neighbours[order[second]].push_back(order[first]);
+		}
+	}
+	return neighbours;
+}
+
+// Works out the outlines of the union of the polygons. The polygons all need to be counter clockwise. This works by cutting every edge where it crosses
+// or touches another polygon, throwing away the pieces that are inside another polygon or are shared by two polygons, and joining up what's left
+static bool mergePolygons(const vector<MergePolygon>& polygons, vector<vector<MergePoint>>* outlines) {
+	vector<vector<int>> neighbours = findNeighbours(polygons);
+
+	// Cut the edges into pieces and keep the ones that are on the outside
+	vector<MergeEdge> fragments;
+	for (int i = 0; i < polygons.size(); i++) {
+		const vector<MergePoint>& points = polygons[i].points;
+		for (int edgeIndex = 0; edgeIndex < points.size(); edgeIndex++) {
+			MergePoint start = points[edgeIndex];
+			MergePoint end = points[(edgeIndex + 1) % points.size()];
+
+			vector<double> splits = { 0, 1 };
+			for (int j : neighbours[i]) {
+				const vector<MergePoint>& otherPoints = polygons[j].points;
+				for (int otherIndex = 0; otherIndex < otherPoints.size(); otherIndex++)
+					findSplitPoints(start, end, otherPoints[otherIndex], otherPoints[(otherIndex + 1) % otherPoints.size()], &splits);
+			}
+			sort(splits.begin(), splits.end());
+
+			MergePoint edge = subtract(end, start);
+			for (int s = 0; s + 1 < splits.size(); s++) {
+				MergePoint fragmentStart = { start.x + edge.x * splits[s], start.y + edge.y * splits[s] };
+				MergePoint fragmentEnd = { start.x + edge.x * splits[s + 1], start.y + edge.y * splits[s + 1] };
+				if (length(subtract(fragmentEnd, fragmentStart)) < MERGE_EPSILON) continue;
+
+				MergePoint middle = { (fragmentStart.x + fragmentEnd.x) / 2, (fragmentStart.y + fragmentEnd.y) / 2 };
+				MergePoint direction = subtract(fragmentEnd, fragmentStart);
+
+				bool keep = true;
+				for (int j : neighbours[i]) {
+					if (!keep) break;
+
+					int boundaryDirection = getBoundaryDirection(middle, direction, polygons[j]);
+					// Two polygons that are next to each other share this piece, so it's inside the merged shape
+					if (boundaryDirection == -1)
+						keep = false;
+					// Two polygons have the same edge here. Only the first one keeps it
+					else if (boundaryDirection == 1)
+						keep = i < j;
+					else if (isPointInPolygon(middle, polygons[j]))
+						keep = false;
+				}
+
+				if (keep)
+					fragments.push_back({ fragmentStart, fragmentEnd, i });
+			}
+		}
+	}
+
+	// Join the pieces back up into outlines. The pieces are looked up by where they start
+	auto getKey = [](MergePoint point) { return make_pair((long long)llround(point.x * MERGE_SNAP_SCALE), (long long)llround(point.y * MERGE_SNAP_SCALE)); };
+	map<pair<long long, long long>, vector<int>> fragmentsByStart;
+	for (int i = 0; i < fragments.size(); i++)
+		fragmentsByStart[getKey(fragments[i].start)].push_back(i);
+
+	vector<bool> used(fragments.size(), false);
+	for (int first = 0; first < fragments.size(); first++) {
+		if (used[first]) continue;
+
+		vector<MergePoint> outline;
+		pair<long long, long long> startKey = getKey(fragments[first].start);
+		int current = first;
+		while (true) {
+			used[current] = true;
+			outline.push_back(fragments[current].start);
+
+			pair<long long, long long> endKey = getKey(fragments[current].end);
+			if (endKey == startKey) break;
+
+			// Where more than one piece starts at the same point (like two boxes touching at a corner) we take the one that turns left the most.
+			// The solid part is on the left, so this keeps the outlines from crossing over each other
+			MergePoint direction = subtract(fragments[current].end, fragments[current].start);
+			int next = -1;
+			double bestTurn = -10;
+			for (int candidate : fragmentsByStart[endKey]) {
+				if (used[candidate]) continue;
+
+				MergePoint candidateDirection = subtract(fragments[candidate].end, fragments[candidate].start);
+				double turn = atan2(cross(direction, candidateDirection), dot(direction, candidateDirection));
+				if (turn > bestTurn) {
+					bestTurn = turn;
+					next = candidate;
+				}
+			}
+
+			// The pieces don't join up, so something is wrong with the polygons
+			if (next == -1) return false;
+			current = next;
+		}
+
+		simplifyOutline(&outline);
+		if (outline.size() < 3 || fabs(getSignedArea(outline)) < MERGE_EPSILON) return false;
+
+		outlines->push_back(outline);
+	}
+
+	return true;
+}
+
+bool isMergeableHitbox(const LevelObject& object) {
+	if (object.type == "entity" || object.type == "mp" || object.type == "path" || object.type == "ladder" || object.type == "button" || object.type == "finish") return false;
+	return object.properties.empty() && object.points.size() >= 3;
+}
+
+HitboxStats getStaticHitboxStats(const vector<LevelObject>& objects) {
+	HitboxStats stats;
+	for (const LevelObject& object : objects) {
+		if (object.type == "entity" || object.type == "mp" || object.type == "path") continue;
+
+		stats.fixtures++;
+		// Finish points are polygons, which only have one proxy. Everything else is a chain loop with a proxy for every edge
+		stats.proxies += object.type == "finish" ? 1 : (int)object.points.size();
+	}
+	return stats;
+}
+
+void mergeStaticHitboxes(vector<LevelObject>* objects, float cellSize) {
+	// Group the mergeable hitboxes by their type, and by their cell if there are cells
+	map<tuple<string, int, int>, vector<int>> groups;
+	for (int i = 0; i < objects->size(); i++) {
+		const LevelObject& object = (*objects)[i];
+		if (!isMergeableHitbox(object)) continue;
+
+		int cellX = 0;
+		int cellY = 0;
+		if (cellSize > 0) {
+			float left = object.points[0].x, right = left, top = object.points[0].y, bottom = top;
+			for (const SDL_FPoint& point : object.points) {
+				left = min(left, point.x);
+				right = max(right, point.x);
+				top = min(top, point.y);
+				bottom = max(bottom, point.y);
+			}
+
+			// The outline of a group can't go outside of the hitboxes in it, so as long as every hitbox is inside its cell the outlines will be too.
+			// A hitbox that sits right on the edge of its cell still counts as inside it
+			cellX = (int)floor((object.x + left) / cellSize);
+			cellY = (int)floor((object.y + top) / cellSize);
+			if (object.x + right > (cellX + 1) * cellSize || object.y + bottom > (cellY + 1) * cellSize) continue;
+		}
+
+		groups[make_tuple(object.type, cellX, cellY)].push_back(i);
+	}
+
+	vector<bool> replaced(objects->size(), false);
+	vector<LevelObject> mergedObjects;
+
+	for (auto& group : groups) {
+		if (group.second.size() < 2) continue;
+
+		vector<MergePolygon> polygons;
+		for (int objectIndex : group.second) {
+			const LevelObject& object = (*objects)[objectIndex];
+
+			MergePolygon polygon;
+			for (const SDL_FPoint& point : object.points)
+				polygon.points.push_back({ (double)object.x + point.x, -((double)object.y + point.y) });
+
+			// Tiled doesn't care which way round a polygon goes, but the merging does
+			if (getSignedArea(polygon.points) < 0)
+				reverse(polygon.points.begin(), polygon.points.end());
+
+			polygon.left = polygon.right = polygon.points[0].x;
+			polygon.bottom = polygon.top = polygon.points[0].y;
+			for (const MergePoint& point : polygon.points) {
+				polygon.left = min(polygon.left, point.x);
+				polygon.right = max(polygon.right, point.x);
+				polygon.bottom = min(polygon.bottom, point.y);
+				polygon.top = max(polygon.top, point.y);
+			}
+			polygons.push_back(polygon);
+		}
+
+		vector<vector<MergePoint>> outlines;
+		if (!mergePolygons(polygons, &outlines)) {
+			SDL_Log("Couldn't merge the \"%s\" hitboxes, they will be left as they are", get<0>(group.first).c_str());
+			continue;
+		}
+
+		for (int objectIndex : group.second)
+			replaced[objectIndex] = true;
+
+		// Each outline becomes a new object. The position is the first point and the points are relative to it, the same as Tiled does it
+		for (const vector<MergePoint>& outline : outlines) {
+			LevelObject mergedObject;
+			mergedObject.type = get<0>(group.first);
+			mergedObject.x = (float)outline[0].x;
+			mergedObject.y = (float)-outline[0].y;
+			for (const MergePoint& point : outline)
+				mergedObject.points.push_back({ (float)(point.x - outline[0].x), (float)(-point.y - mergedObject.y) });
+			mergedObjects.push_back(mergedObject);
+		}
+	}
+
+	vector<LevelObject> result;
+	for (int i = 0; i < objects->size(); i++) {
+		if (!replaced[i])
+			result.push_back(move((*objects)[i]));
+	}
+	for (LevelObject& mergedObject : mergedObjects)
+		result.push_back(move(mergedObject));
+
+	*objects = move(result);
+}
+
+int addTileHitboxes(LevelData* level, const unordered_map<Uint32, string>& collisionTiles, int tileWidth, int tileHeight) {
+	if (collisionTiles.empty() || level->width <= 0 || level->height <= 0) return 0;
+
+	// Work out which type of hitbox each cell needs, as an index into types. -1 means the cell isn't solid. If more than one layer has a solid
+	// tile in the same cell then the top one wins
+	vector<string> types;
+	unordered_map<string, int> typeIndices;
+	vector<int> cells((size_t)level->width * level->height, -1);
+	for (const vector<Uint32>& layer : level->tileLayers) {
+		for (int i = 0; i < cells.size() && i < layer.size(); i++) {
+			auto collisionTile = collisionTiles.find(layer[i]);
+			if (collisionTile == collisionTiles.end()) continue;
+
+			auto typeIndex = typeIndices.find(collisionTile->second);
+			if (typeIndex == typeIndices.end()) {
+				typeIndex = typeIndices.insert(make_pair(collisionTile->second, (int)types.size())).first;
+				types.push_back(collisionTile->second);
+			}
+			cells[i] = typeIndex->second;
+		}
+	}
+
+	// Greedy meshing. Starting from the top left, each solid cell that isn't in a rectangle yet starts a new one, which is made as wide as it can go
+	// and then as tall as it can go while every cell in the next row down is the same type. This only looks at each cell a couple of times, so it's
+	// fine on huge maps. Rectangles stop at the edges of the cells so each one is inside a single chunk
+	int rectangleCount = 0;
+	for (int y = 0; y < level->height; y++) {
+		for (int x = 0; x < level->width; x++) {
+			int type = cells[y * level->width + x];
+			if (type == -1) continue;
+
+			int width = 1;
+			while (x + width < level->width && (x + width) % TILE_HITBOX_CELL_SIZE != 0 && cells[y * level->width + x + width] == type)
+				width++;
+
+			int height = 1;
+			while (y + height < level->height && (y + height) % TILE_HITBOX_CELL_SIZE != 0) {
+				bool rowMatches = true;
+				for (int i = 0; i < width && rowMatches; i++)
+					rowMatches = cells[(y + height) * level->width + x + i] == type;
+				if (!rowMatches) break;
+				height++;
+			}
+
+			for (int rectangleY = y; rectangleY < y + height; rectangleY++) {
+				for (int rectangleX = x; rectangleX < x + width; rectangleX++)
+					cells[rectangleY * level->width + rectangleX] = -1;
+			}
+
+			// The points go down the left side first so the rectangle is counter clockwise once y is flipped for Box2D, the same as the merged outlines
+			LevelObject hitbox;
+			hitbox.type = types[type];
+			hitbox.x = (float)(x * tileWidth);
+			hitbox.y = (float)(y * tileHeight);
+			float right = (float)(width * tileWidth);
+			float bottom = (float)(height * tileHeight);
+			hitbox.points = { { 0, 0 }, { 0, bottom }, { right, bottom }, { right, 0 } };
+			level->objects.push_back(hitbox);
+			rectangleCount++;
+		}
+	}
+
+	return rectangleCount;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <cmath>
+#include <algorithm>
+#include <tuple>
+
+#include <SDL.h>
+
+#include "LevelFormat.h"
+
+using namespace std;
+
+// The rectangles made for solid tiles never cross a multiple of this many tiles. This is the same as the size of the chunks that levels are streamed
+// in, so streamed levels can still merge them within each chunk. Levels that aren't streamed merge them back together across the lines anyway
+#define TILE_HITBOX_CELL_SIZE 16
+
+// Levels are made out of lots of small hand drawn hitboxes that overlap and touch each other. Each one used to be its own body with its own chain loop,
+// and every edge of every chain is a separate proxy in the Box2D broadphase. This merges the solid hitboxes into as few outlines as possible so there
+// are less fixtures and proxies, and the edges inside the solid parts (which the player can never touch) go away
+
+// Only hitboxes that are solid and have nothing special about them are merged. Sensors (ladders, buttons and finish points) and anything with
+// properties are left alone. Hitboxes are only merged with hitboxes of the same type, so dangerous tiles stay dangerous
+bool isMergeableHitbox(const LevelObject& object);
+
+// How many fixtures and broadphase proxies the static hitboxes of a level make. Each edge of a chain is its own proxy
+struct HitboxStats {
+	int fixtures = 0;
+	int proxies = 0;
+};
+HitboxStats getStaticHitboxStats(const vector<LevelObject>& objects);
+
+// Replaces the mergeable hitboxes with the outlines of their union. If something goes wrong merging a group of hitboxes (like a hitbox that
+// crosses over itself) then that group is left as it was.
+// Streamed levels pass the size of their chunks (in pixels) as the cell size. Hitboxes are then only merged with the other hitboxes inside the same
+// chunk, and hitboxes that cross the edge of a chunk aren't merged at all. Otherwise the ground of a long level would become one outline that
+// covers the whole map, which would be in the physics world whenever any chunk it touches is streamed in
+void mergeStaticHitboxes(vector<LevelObject>* objects, float cellSize = 0);
+
+// Makes hitboxes for the solid tiles of a level so they don't have to be drawn by hand in the "collisions" layer. collisionTiles says which GIDs are
+// solid and what type of hitbox they make ("" for normal ground). The solid tiles are covered with as few rectangles as possible, which are added
+// to the level's objects. mergeStaticHitboxes then joins them (and any hand drawn hitboxes they touch) into outlines. Returns how many were added
+int addTileHitboxes(LevelData* level, const unordered_map<Uint32, string>& collisionTiles, int tileWidth, int tileHeight);
@@ -0,0 +1,198 @@
+#include "ContactBenchmark.h"
+
+// How many entities are piled up on the player. More entities means more contacts, and a mix of contacts that hit and miss the table
+#define BENCHMARK_ENTITY_COUNT 24
+// Each listener is run over all of the contacts this many times
+#define BENCHMARK_PASSES 20000
+
+// The listener before the dispatch table, which checks the player's fixtures first and then switches on the other fixture. It has its own counters
+// so it can be timed against the real listener
+class SwitchCollisionListener : public b2ContactListener {
+public:
+	int playerGroundContacts = 0;
+	int playerDangerContacts = 0;
+	int playerLadderContacts = 0;
+	int playerFinishPointContacts = 0;
+	int levelEntranceNum = -1;
+	set<b2Body*> movingPlatforms;
+	set<b2Fixture*> entityFixturesUnderfoot;
+	unordered_map<int, int> buttons;
+	b2Body* playerBody = NULL;
+
+	void BeginContact(b2Contact* contact) { updateContact(contact, true); }
+	void EndContact(b2Contact* contact) { updateContact(contact, false); }
+
+private:
+	static const FixtureTag* getFixtureTag(b2Fixture* fixture) {
+		static const FixtureTag untaggedFixture = { FixtureKind::GROUND, -1, -1 };
+		const FixtureTag* tag = (const FixtureTag*)fixture->GetUserData();
+		return tag != NULL ? tag : &untaggedFixture;
+	}
+
+	void updateContact(b2Contact* contact, bool touching) {
+		b2Fixture* fixtureA = contact->GetFixtureA();
+		b2Fixture* fixtureB = contact->GetFixtureB();
+		const FixtureTag* tagA = getFixtureTag(fixtureA);
+		const FixtureTag* tagB = getFixtureTag(fixtureB);
+
+		if (tagB->kind == FixtureKind::PLAYER_BODY || tagB->kind == FixtureKind::PLAYER_SENSOR) {
+			swap(fixtureA, fixtureB);
+			swap(tagA, tagB);
+		}
+
+		int change = touching ? 1 : -1;
+
+		switch (tagA->kind) {
+		case FixtureKind::PLAYER_BODY:
+			switch (tagB->kind) {
+			case FixtureKind::LADDER:
+				playerLadderContacts += change;
+				break;
+			case FixtureKind::DANGEROUS_TILE:
+				playerDangerContacts += change;
+				break;
+			case FixtureKind::FINISH_POINT:
+				playerFinishPointContacts += change;
+				levelEntranceNum = touching ? tagB->linkedID : -1;
+				break;
+			case FixtureKind::BUTTON:
+				if (tagB->linkedID >= 0)
+					buttons[tagB->linkedID] += change;
+				break;
+			default:
+				break;
+			}
+			break;
+
+		case FixtureKind::PLAYER_SENSOR:
+			switch (tagB->kind) {
+			case FixtureKind::LADDER:
+			case FixtureKind::DANGEROUS_TILE:
+			case FixtureKind::FINISH_POINT:
+			case FixtureKind::BUTTON:
+				break;
+			case FixtureKind::MOVING_PLATFORM:
+				if (touching)
+					movingPlatforms.insert(fixtureB->GetBody());
+				else
+					movingPlatforms.erase(fixtureB->GetBody());
+				playerGroundContacts += change;
+				break;
+			case FixtureKind::ENTITY:
+				if (touching)
+					entityFixturesUnderfoot.insert(fixtureB);
+				else
+					entityFixturesUnderfoot.erase(fixtureB);
+				playerGroundContacts += change;
+				break;
+			default:
+				playerGroundContacts += change;
+				break;
+			}
+			break;
+
+		default:
+			if (tagB->kind == FixtureKind::BUTTON && tagB->linkedID >= 0)
+				buttons[tagB->linkedID] += change;
+			else if (tagA->kind == FixtureKind::BUTTON && tagA->linkedID >= 0)
+				buttons[tagA->linkedID] += change;
+			break;
+		}
+
+		if (playerBody != NULL) {
+			if (touching && playerLadderContacts > 0)
+				playerBody->SetGravityScale(0);
+			else if (!touching && playerLadderContacts < 1)
+				playerBody->SetGravityScale(1);
+		}
+	}
+};
+
+// Runs begin and end contact for every contact, so the counters are back where they started after each pass. Returns the time it took in seconds
+static double timeListener(b2ContactListener* listener, const vector<b2Contact*>& contacts) {
+	Uint64 startTime = SDL_GetPerformanceCounter();
+	for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+		for (b2Contact* contact : contacts)
+			listener->BeginContact(contact);
+		for (b2Contact* contact : contacts)
+			listener->EndContact(contact);
+	}
+	return (double)(SDL_GetPerformanceCounter() - startTime) / SDL_GetPerformanceFrequency();
+}
+
+static b2Body* addBox(b2World* world, b2BodyType type, b2Vec2 position, float halfWidth, float halfHeight, FixtureTag* tag, bool isSensor) {
+	b2BodyDef bodyDef;
+	bodyDef.type = type;
+	bodyDef.position = position;
+	b2Body* body = world->CreateBody(&bodyDef);
+
+	b2PolygonShape shape;
+	shape.SetAsBox(halfWidth, halfHeight);
+	b2FixtureDef fixtureDef;
+	fixtureDef.shape = &shape;
+	fixtureDef.density = 1.0;
+	fixtureDef.isSensor = isSensor;
+	fixtureDef.userData = tag;
+	body->CreateFixture(&fixtureDef);
+
+	return body;
+}
+
+void runContactBenchmark() {
+	FixtureTag groundTag = { FixtureKind::GROUND, -1, -1 };
+	FixtureTag ladderTag = { FixtureKind::LADDER, -1, -1 };
+	FixtureTag dangerTag = { FixtureKind::DANGEROUS_TILE, -1, -1 };
+	FixtureTag finishTag = { FixtureKind::FINISH_POINT, 2, -1 };
+	FixtureTag buttonTag = { FixtureKind::BUTTON, 0, -1 };
+	FixtureTag platformTag = { FixtureKind::MOVING_PLATFORM, 1, -1 };
+	FixtureTag entityTag = { FixtureKind::ENTITY, -1, -1 };
+	FixtureTag playerBodyTag = { FixtureKind::PLAYER_BODY, -1, -1 };
+	FixtureTag playerSensorTag = { FixtureKind::PLAYER_SENSOR, -1, -1 };
+
+	// No gravity, so nothing moves apart while the contacts are being found
+	b2World world(b2Vec2(0, 0));
+	addBox(&world, b2_staticBody, b2Vec2(0, -1), 4, 1, &groundTag, false);
+	addBox(&world, b2_staticBody, b2Vec2(0, 1), 1, 2, &ladderTag, true);
+	addBox(&world, b2_staticBody, b2Vec2(1, 0.5f), 1, 0.5f, &dangerTag, false);
+	addBox(&world, b2_staticBody, b2Vec2(-1, 0.5f), 1, 1, &finishTag, true);
+	addBox(&world, b2_staticBody, b2Vec2(0, 0.1f), 2, 0.1f, &buttonTag, true);
+	addBox(&world, b2_kinematicBody, b2Vec2(0, 0), 1, 0.25f, &platformTag, false);
+	for (int i = 0; i < BENCHMARK_ENTITY_COUNT; i++)
+		addBox(&world, b2_dynamicBody, b2Vec2((i % 6) * 0.3f - 0.75f, (i / 6) * 0.3f), 0.25f, 0.25f, &entityTag, false);
+
+	b2Body* playerBody = addBox(&world, b2_dynamicBody, b2Vec2(0, 0.5f), 0.48f, 0.48f, &playerBodyTag, false);
+	b2PolygonShape sensorShape;
+	sensorShape.SetAsBox(0.38f, 0.1f, b2Vec2(0, -0.48f), 0);
+	b2FixtureDef sensorDef;
+	sensorDef.shape = &sensorShape;
+	sensorDef.isSensor = true;
+	sensorDef.userData = &playerSensorTag;
+	playerBody->CreateFixture(&sensorDef);
+
+	// One step finds all of the contacts. There isn't a listener yet, so nothing is counted
+	world.Step(0.0001f, 1, 1);
+	vector<b2Contact*> contacts;
+	for (b2Contact* contact = world.GetContactList(); contact != NULL; contact = contact->GetNext())
+		contacts.push_back(contact);
+
+	CollisionListener tableListener;
+	tableListener.buttons.assign(1, 0);
+	tableListener.clear();
+	tableListener.SetPlayerBody(playerBody);
+	SwitchCollisionListener switchListener;
+	switchListener.playerBody = playerBody;
+
+	// Run each one once first so the sets and the button map have already allocated what they need
+	timeListener(&tableListener, contacts);
+	timeListener(&switchListener, contacts);
+
+	double tableSeconds = timeListener(&tableListener, contacts);
+	double switchSeconds = timeListener(&switchListener, contacts);
+
+	// Each pass is a begin and an end for every contact
+	double contactCount = (double)contacts.size() * BENCHMARK_PASSES * 2;
+	SDL_Log("Contact benchmark: %d contacts, %d passes", (int)contacts.size(), BENCHMARK_PASSES);
+	SDL_Log("Switch listener: %.1f million contacts per second (%.2fns per contact)", contactCount / switchSeconds / 1000000.0, switchSeconds * 1000000000.0 / contactCount);
+	SDL_Log("Dispatch table listener: %.1f million contacts per second (%.2fns per contact)", contactCount / tableSeconds / 1000000.0, tableSeconds * 1000000000.0 / contactCount);
+	SDL_Log("The dispatch table is %.2fx the speed of the switch", switchSeconds / tableSeconds);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <SDL.h>
+#include <box2d.h>
+
+#include "Box2dOverrides.h"
+
+// Times how many contacts per second the collision listener can get through. Started with --bench-contacts, which runs it and quits instead of
+// starting the game. It makes a small world with the player standing on the ground in the middle of a ladder, a button, a finish point, some
+// dangerous tiles, a moving platform and a pile of entities, then runs begin and end contact for every contact in it over and over. The dispatch
+// table is compared with the nested switch that the listener used before it, with both of them given the same contacts
+void runContactBenchmark();
@@ -1,26 +1,32 @@
 #include "FontHandler.h"
 
-FontHandler::FontHandler(SDL_Renderer* ren) {
+FontHandler::FontHandler(SDL_Renderer* ren, SpriteBatch* batch, TextureAtlas* atlas) {
 	renderer = ren;
+	spriteBatch = batch;
+	textureAtlas = atlas;
 }
 
 FontHandler::~FontHandler() {
+	// The character textures are in the texture atlas, which destroys them itself
 	cout << "Font dc called" << endl;
-
-	// Loop through all of the fonts and clear the memory taken by the texture
-	for (auto const& font : fonts) {
-		for (auto charTexturePair : font.second.textures) {
-			SDL_DestroyTexture(charTexturePair.second);
-			charTexturePair.second = NULL;
-		}
-	}
 }
 
 bool FontHandler::loadFont(string fontIdentifier, const char* fontFilename, int fontSize)
 {
+	PROFILE_FUNCTION();
+
 	// The font indentifier should be unique, so we check to see if we already have one with this name
 	if (fonts.count(fontIdentifier) > 0) return false;
 
+	FH_RasterizedFont rasterizedFont;
+	if (!rasterizeFont(fontFilename, fontSize, &rasterizedFont)) return false;
+
+	return addRasterizedFont(fontIdentifier, &rasterizedFont);
+}
+
+bool FontHandler::rasterizeFont(const char* fontFilename, int fontSize, FH_RasterizedFont* output) {
+	PROFILE_FUNCTION();
+
 	// We need to load the font once at the start
 	TTF_Font* font = NULL;
 	font = TTF_OpenFont(fontFilename, fontSize);
@@ -28,10 +34,9 @@ bool FontHandler::loadFont(string fontIdentifier, const char* fontFilename, int
 	if (font == NULL) return false;
 
 	// Get the information of the font for later use
-	FH_Font fhFont;
-	TTF_SizeText(font, "G", &fhFont.width, &fhFont.height);
+	TTF_SizeText(font, "G", &output->width, &output->height);
 
-	// Now we go through every character and get a texture from it
+	// Now we go through every character and get a surface for it
 	for (int i = 0; i < alphabet.length(); i++) {
 		string singularChar(1, alphabet[i]);
 
@@ -39,19 +44,18 @@ bool FontHandler::loadFont(string fontIdentifier, const char* fontFilename, int
 		SDL_Color fontColor = { 0, 0, 0, 255 };
 		SDL_Surface* characterSurface = TTF_RenderText_Solid(font, singularChar.c_str(), fontColor);
 
-		// Now we can convert it to a texture for easy rendering
-		SDL_Texture* characterTexture = SDL_CreateTextureFromSurface(renderer, characterSurface);
+		if (characterSurface == NULL) continue;
 
-		// Now that we have a texture, we no longer need the old surface
+		// The atlas would have to convert it anyway, and doing it here keeps that work off the main thread. This also turns the colour key
+		// into transparent pixels
+		SDL_Surface* convertedSurface = SDL_ConvertSurfaceFormat(characterSurface, SDL_PIXELFORMAT_RGBA32, 0);
 		SDL_FreeSurface(characterSurface);
 		characterSurface = NULL;
 
-		// Add the texture to the map for rendering later
-		fhFont.textures.insert(make_pair(alphabet[i], characterTexture));
+		if (convertedSurface != NULL)
+			output->characters.push_back(make_pair(alphabet[i], convertedSurface));
 	}
 
-	fonts.insert(make_pair(fontIdentifier, fhFont));
-
 	// We no longer need the font
 	TTF_CloseFont(font);
 	font = NULL;
@@ -59,12 +63,42 @@ bool FontHandler::loadFont(string fontIdentifier, const char* fontFilename, int
 	return true;
 }
 
+bool FontHandler::addRasterizedFont(string fontIdentifier, FH_RasterizedFont* font) {
+	PROFILE_FUNCTION();
+
+	// The font indentifier should be unique, so we check to see if we already have one with this name
+	bool result = fonts.count(fontIdentifier) == 0;
+
+	FH_Font fhFont;
+	fhFont.width = font->width;
+	fhFont.height = font->height;
+
+	for (pair<char, SDL_Surface*>& character : font->characters) {
+		// Now we can pack it into the atlas for easy rendering. The name needs to be unique for each font and character
+		AtlasRegion characterRegion;
+		if (result && textureAtlas->addSurface(fontIdentifier + ":" + string(1, character.first), character.second, &characterRegion))
+			// Add the character to the map for rendering later
+			fhFont.textures.insert(make_pair(character.first, characterRegion));
+
+		// Now that it's in the atlas, we no longer need the surface
+		SDL_FreeSurface(character.second);
+	}
+	font->characters.clear();
+
+	if (result)
+		fonts.insert(make_pair(fontIdentifier, fhFont));
+
+	return result;
+}
+
 void FontHandler::renderFont(string fontIdentifier, string text, float x, float y) {
+	PROFILE_FUNCTION();
+
 	// For FPS testing
 	// return;
 
 	if (fonts.count(fontIdentifier) < 1) return;
-	FH_Font font = fonts[fontIdentifier];
+	FH_Font& font = fonts[fontIdentifier];
 
 	text += "\n";
 	float originalX = x;
@@ -88,7 +122,8 @@ void FontHandler::renderFont(string fontIdentifier, string text, float x, float
 		for (int c = 0; c < substrings[i].size(); c++) {
 			// The rectangle that decides where to render the texture on the screen
 			SDL_Rect destinationRect = { (int)x, (int)y, font.width, font.height };
-			SDL_RenderCopy(renderer, font.textures[substrings[i][c]], NULL, &destinationRect);
+			AtlasRegion& character = font.textures[substrings[i][c]];
+			spriteBatch->draw(character.texture, &character.rect, &destinationRect);
 
 			// Now that we've rendered, we need to increase the starting position for the next character
 			x += font.width;
@@ -97,4 +132,12 @@ void FontHandler::renderFont(string fontIdentifier, string text, float x, float
 		y += font.height;
 		x = originalX;
 	}
-}
\ No newline at end of file
+}
+
+bool FontHandler::getFontSize(string fontIdentifier, int* width, int* height) {
+	if (fonts.count(fontIdentifier) < 1) return false;
+
+	*width = fonts[fontIdentifier].width;
+	*height = fonts[fontIdentifier].height;
+	return true;
+}
@@ -9,22 +9,41 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+#include "SpriteBatch.h"
+#include "TextureAtlas.h"
+#include "Profiler.h"
+
 using namespace std;
 
 // A struct for holding data about a font
 struct FH_Font {
 	int width;
 	int height;
-	unordered_map<char, SDL_Texture*> textures;
+	// Where each character is in the texture atlas
+	unordered_map<char, AtlasRegion> textures;
+};
+
+// A font that has had its characters rendered, but hasn't been packed into the atlas yet. The character surfaces are already in the atlas' format
+struct FH_RasterizedFont {
+	int width = 0;
+	int height = 0;
+	vector<pair<char, SDL_Surface*>> characters;
 };
 
 class FontHandler
 {
 public:
-	FontHandler(SDL_Renderer* ren);
+	FontHandler(SDL_Renderer* ren, SpriteBatch* batch, TextureAtlas* atlas);
 	~FontHandler();
 	bool loadFont(string fontIdentifier, const char* fontFilename, int fontSize);
+	// Loading a font is split in two so the slow part can be done on a loading thread. rasterizeFont() opens the font and renders every character,
+	// and doesn't touch the atlas or the loaded fonts. SDL_ttf can't be used by two threads at once though, so only one thread can be rasterizing at a time.
+	// addRasterizedFont() packs the characters into the atlas on the main thread and frees the surfaces
+	bool rasterizeFont(const char* fontFilename, int fontSize, FH_RasterizedFont* output);
+	bool addRasterizedFont(string fontIdentifier, FH_RasterizedFont* font);
 	void renderFont(string fontIdentifier, string text, float x, float y);
+	// Gets the size of one character of a font. All of the characters are the same size. Returns false if the font isn't loaded
+	bool getFontSize(string fontIdentifier, int* width, int* height);
 
 private:
 	// This will hold the texture for each character of each font that is loaded
@@ -32,6 +51,10 @@ private:
 
 	// The renderer pointer that is needed for creating textures and rendering them
 	SDL_Renderer* renderer = NULL;
+	// The characters are drawn through the sprite batch
+	SpriteBatch* spriteBatch = NULL;
+	// The characters are packed into the atlas, so a whole string can be drawn from one texture
+	TextureAtlas* textureAtlas = NULL;
 
 	// An alphabet (with numbers) that we can loop through to get stuff
 	string alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ 1234567890?!-:/.";
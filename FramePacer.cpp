@@ -0,0 +1,159 @@
+#include "FramePacer.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+// Older versions of the windows SDK don't have this flag, even though windows 10 supports it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+FramePacer::FramePacer() {}
+
+FramePacer::~FramePacer() {
+	#ifdef _WIN32
+	if (waitableTimer != NULL)
+		CloseHandle((HANDLE)waitableTimer);
+	#endif
+}
+
+void FramePacer::setup(FramePacingMode mode, int framesPerSecond) {
+	this->mode = mode;
+	frameDuration = NANOSECONDS_PER_SECOND / (framesPerSecond > 0 ? framesPerSecond : 60);
+
+	#ifdef _WIN32
+	// A high resolution timer can wake up within a fraction of a millisecond of when we asked. Normal timers can be a millisecond or two late
+	// (or much more if nothing has asked windows for a higher timer resolution), so hybrid mode needs to spin for longer with them
+	if (waitableTimer == NULL) {
+		waitableTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (waitableTimer == NULL) {
+			waitableTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+			spinMargin = 2000000;
+		}
+	}
+	#endif
+
+	previousFrameStart = getTime();
+	nextDeadline = previousFrameStart + frameDuration;
+
+	SDL_Log("Frame pacing mode: %s at %d fps", getModeName(mode), framesPerSecond);
+}
+
+void FramePacer::waitForNextFrame() {
+	// With vsync SDL_RenderPresent has already waited for the display, so there is nothing to wait for here
+	if (mode == FramePacingMode::SLEEP) {
+		sleepUntil(nextDeadline);
+	}
+	else if (mode == FramePacingMode::HYBRID) {
+		if (nextDeadline > spinMargin)
+			sleepUntil(nextDeadline - spinMargin);
+
+		// Spin for the last little bit. Yielding lets other threads run while we wait, which is still much better than sleeping and waking up late
+		Uint64 spinStart = getTime();
+		Uint64 currentTime = spinStart;
+		while (currentTime < nextDeadline) {
+			this_thread::yield();
+			currentTime = getTime();
+		}
+		spinningTime += currentTime - spinStart;
+	}
+
+	Uint64 frameStart = getTime();
+
+	// Record how far this frame was from the length it should have been
+	double jitter = fabs((double)(frameStart - previousFrameStart) - (double)frameDuration) / 1000000.0;
+	measuredFrames++;
+	jitterSum += jitter;
+	jitterSquaredSum += jitter * jitter;
+	if (jitter > maxJitter) maxJitter = jitter;
+	if ((frameStart - previousFrameStart) * 2 > frameDuration * 3) lateFrames++;
+	previousFrameStart = frameStart;
+
+	// The deadlines are absolute, so a frame that starts a little late is made up for by the next one being a little shorter. If we fell
+	// way behind though (like when the window is being dragged), we start again from now instead of rushing through a bunch of frames to catch up
+	nextDeadline += frameDuration;
+	if (nextDeadline < frameStart)
+		nextDeadline = frameStart + frameDuration;
+}
+
+void FramePacer::logStats() {
+	if (measuredFrames == 0) return;
+
+	double meanJitter = jitterSum / measuredFrames;
+	double jitterVariance = jitterSquaredSum / measuredFrames - meanJitter * meanJitter;
+	double jitterStandardDeviation = sqrt(jitterVariance > 0 ? jitterVariance : 0);
+
+	SDL_Log("Frame pacing (%s): %lu frames, mean jitter %.3f ms, jitter std dev %.3f ms, max jitter %.3f ms, %lu late frames, %.3f ms spinning per frame",
+		getModeName(mode), measuredFrames, meanJitter, jitterStandardDeviation, maxJitter, lateFrames, (double)spinningTime / measuredFrames / 1000000.0);
+}
+
+bool FramePacer::parseMode(string name, FramePacingMode* mode) {
+	if (name == "vsync") *mode = FramePacingMode::VSYNC;
+	else if (name == "sleep") *mode = FramePacingMode::SLEEP;
+	else if (name == "hybrid") *mode = FramePacingMode::HYBRID;
+	else return false;
+
+	return true;
+}
+
+const char* FramePacer::getModeName(FramePacingMode mode) {
+	switch (mode) {
+	case FramePacingMode::VSYNC:
+		return "vsync";
+	case FramePacingMode::SLEEP:
+		return "sleep";
+	default:
+		return "hybrid";
+	}
+}
+
+Uint64 FramePacer::getTime() {
+	#if defined(__linux__) || defined(__ANDROID__)
+	// This is the same clock that clock_nanosleep uses, so the deadlines can be passed straight to it
+	timespec currentTime;
+	clock_gettime(CLOCK_MONOTONIC, &currentTime);
+	return (Uint64)currentTime.tv_sec * NANOSECONDS_PER_SECOND + currentTime.tv_nsec;
+	#else
+	// The counter is split into seconds and the remainder so that multiplying by a billion doesn't overflow
+	Uint64 counter = SDL_GetPerformanceCounter();
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	return (counter / frequency) * NANOSECONDS_PER_SECOND + (counter % frequency) * NANOSECONDS_PER_SECOND / frequency;
+	#endif
+}
+
+void FramePacer::sleepUntil(Uint64 deadline) {
+	#if defined(__linux__) || defined(__ANDROID__)
+	// Sleeping until an absolute time means that the time spent getting here doesn't get added on to the sleep.
+	// The sleep can be interrupted by a signal, in which case we just go back to sleep
+	timespec deadlineTime;
+	deadlineTime.tv_sec = (time_t)(deadline / NANOSECONDS_PER_SECOND);
+	deadlineTime.tv_nsec = (long)(deadline % NANOSECONDS_PER_SECOND);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadlineTime, NULL) == EINTR) {}
+	#else
+	Uint64 currentTime = getTime();
+	if (currentTime >= deadline) return;
+
+	#ifdef _WIN32
+	// Windows doesn't have absolute sleeps on this clock, so the deadline is turned into a relative one. Negative due times are relative and in 100ns units
+	if (waitableTimer != NULL) {
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)((deadline - currentTime) / 100);
+		if (SetWaitableTimer((HANDLE)waitableTimer, &dueTime, 0, NULL, NULL, FALSE)) {
+			WaitForSingleObject((HANDLE)waitableTimer, INFINITE);
+			return;
+		}
+	}
+	#endif
+
+	// SDL_Delay only does whole milliseconds, so round down to never wake up after the deadline
+	SDL_Delay((Uint32)((deadline - currentTime) / 1000000));
+	#endif
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <cmath>
+#include <thread>
+
+#include <SDL.h>
+
+using namespace std;
+
+// The different ways of waiting for the next frame.
+// VSYNC lets SDL_RenderPresent wait for the display, so the pacer only keeps track of the frame times.
+// SLEEP sleeps until the exact time the next frame should start, which uses almost no CPU but can wake up a little late.
+// HYBRID sleeps until just before the next frame and spins for the last bit, which is more accurate but uses a bit more CPU.
+enum class FramePacingMode {
+	VSYNC,
+	SLEEP,
+	HYBRID
+};
+
+// The frame pacer makes the game loop run at a steady rate without keeping a CPU core busy. Frames are timed against absolute deadlines,
+// so a frame that wakes up a bit late doesn't push every frame after it back as well. It also records how far each frame was from where
+// it should have been (the jitter), so the modes can be compared
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	// Chooses the mode and how many frames a second to aim for. The first deadline is one frame from now
+	void setup(FramePacingMode mode, int framesPerSecond);
+	// Waits until the next frame should start. This is called once at the end of every frame
+	void waitForNextFrame();
+	// Logs the jitter stats for all of the frames so far
+	void logStats();
+
+	FramePacingMode getMode() { return mode; }
+
+	// Turns a mode name from the command line (vsync, sleep or hybrid) into a mode. Returns false if the name isn't a mode
+	static bool parseMode(string name, FramePacingMode* mode);
+	static const char* getModeName(FramePacingMode mode);
+
+private:
+	FramePacingMode mode = FramePacingMode::HYBRID;
+
+	// All of the times are in nanoseconds
+	Uint64 frameDuration = 0;
+	// When the next frame should start
+	Uint64 nextDeadline = 0;
+	// When the last frame actually started. Used for working out the jitter
+	Uint64 previousFrameStart = 0;
+	// In hybrid mode we stop sleeping this long before the deadline and spin the rest of the way. This needs to be longer than the
+	// amount that the sleep usually overshoots by
+	Uint64 spinMargin = 1000000;
+
+	// The jitter stats. The jitter is how much longer or shorter a frame was than it should have been
+	unsigned long measuredFrames = 0;
+	double jitterSum = 0;
+	double jitterSquaredSum = 0;
+	double maxJitter = 0;
+	// Frames that took more than one and a half times as long as they should have
+	unsigned long lateFrames = 0;
+	// How much time was spent spinning instead of sleeping
+	Uint64 spinningTime = 0;
+
+	// On windows this is a waitable timer handle. It is a void pointer so that windows.h doesn't need to be included everywhere
+	void* waitableTimer = NULL;
+
+	// Gets the current time from a clock that never goes backwards
+	Uint64 getTime();
+	// Sleeps until the given time. This can wake up a little late but never early
+	void sleepUntil(Uint64 deadline);
+};
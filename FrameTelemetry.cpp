@@ -0,0 +1,99 @@
+#include "FrameTelemetry.h"
+
+FrameTelemetry::FrameTelemetry() {
+	counterToMilliseconds = 1000.0 / (double)SDL_GetPerformanceFrequency();
+	currentSample = {};
+}
+
+void FrameTelemetry::beginFrame() {
+	currentSample = {};
+	currentSample.frameNumber = recordedFrames;
+	frameStartTime = SDL_GetPerformanceCounter();
+}
+
+void FrameTelemetry::endFrame() {
+	currentSample.frameTime = (float)((SDL_GetPerformanceCounter() - frameStartTime) * counterToMilliseconds);
+
+	samples[nextSample] = currentSample;
+	nextSample = (nextSample + 1) % TELEMETRY_FRAME_COUNT;
+	recordedFrames++;
+}
+
+void FrameTelemetry::addStageTime(TelemetryStage stage, Uint64 stageStartTime) {
+	currentSample.stageTimes[stage] += (float)((SDL_GetPerformanceCounter() - stageStartTime) * counterToMilliseconds);
+}
+
+TelemetryStats FrameTelemetry::getStats(int stage) {
+	TelemetryStats stats;
+	int sampleCount = getSampleCount();
+	if (sampleCount == 0) return stats;
+
+	vector<float> times(sampleCount);
+	float total = 0;
+	for (int i = 0; i < sampleCount; i++) {
+		times[i] = stage == TELEMETRY_STAGE_COUNT ? samples[i].frameTime : samples[i].stageTimes[stage];
+		total += times[i];
+	}
+
+	stats.min = *min_element(times.begin(), times.end());
+	stats.average = total / sampleCount;
+
+	// We only need the one value for the percentile, so there's no need to sort the whole thing
+	int p99Index = min(sampleCount - 1, sampleCount * 99 / 100);
+	nth_element(times.begin(), times.begin() + p99Index, times.end());
+	stats.p99 = times[p99Index];
+
+	return stats;
+}
+
+bool FrameTelemetry::writeCSV(string filename) {
+	SDL_RWops* file = SDL_RWFromFile(filename.c_str(), "w");
+	if (file == NULL) {
+		SDL_Log("Couldn't open %s for the frame telemetry. Error: %s", filename.c_str(), SDL_GetError());
+		return false;
+	}
+
+	string header = "frame,frame_ms";
+	for (int stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++)
+		header += string(",") + getStageName(stage) + "_ms";
+	header += "\n";
+	SDL_RWwrite(file, header.c_str(), 1, header.size());
+
+	// When the ring buffer has wrapped around, the oldest frame is the one that will be overwritten next
+	int sampleCount = getSampleCount();
+	int firstSample = recordedFrames > TELEMETRY_FRAME_COUNT ? nextSample : 0;
+	for (int i = 0; i < sampleCount; i++) {
+		FrameSample& sample = samples[(firstSample + i) % TELEMETRY_FRAME_COUNT];
+
+		string line = to_string(sample.frameNumber) + "," + to_string(sample.frameTime);
+		for (int stage = 0; stage < TELEMETRY_STAGE_COUNT; stage++)
+			line += "," + to_string(sample.stageTimes[stage]);
+		line += "\n";
+		SDL_RWwrite(file, line.c_str(), 1, line.size());
+	}
+
+	SDL_RWclose(file);
+	SDL_Log("Wrote %d frames of telemetry to %s", sampleCount, filename.c_str());
+	return true;
+}
+
+const char* FrameTelemetry::getStageName(int stage) {
+	switch (stage) {
+	case TELEMETRY_EVENTS:
+		return "events";
+	case TELEMETRY_LOGIC:
+		return "logic";
+	case TELEMETRY_PHYSICS_STEP:
+		return "step";
+	case TELEMETRY_LEVEL_RENDER:
+		return "level";
+	case TELEMETRY_DEBUG_DRAW:
+		return "debug";
+	case TELEMETRY_PRESENT:
+		return "present";
+	case TELEMETRY_WAIT:
+		return "wait";
+	default:
+		return "frame";
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <SDL.h>
+
+using namespace std;
+
+// How many frames of timings are kept. Older frames are overwritten by newer ones
+#define TELEMETRY_FRAME_COUNT 600
+
+// The parts of a frame that are timed. STAGE_COUNT isn't a stage, it's just how many stages there are
+enum TelemetryStage {
+	TELEMETRY_EVENTS,
+	// This includes the physics step, which is also timed on its own
+	TELEMETRY_LOGIC,
+	TELEMETRY_PHYSICS_STEP,
+	TELEMETRY_LEVEL_RENDER,
+	TELEMETRY_DEBUG_DRAW,
+	// Flushing the sprite batch and SDL_RenderPresent
+	TELEMETRY_PRESENT,
+	// Waiting for the frame pacer
+	TELEMETRY_WAIT,
+	TELEMETRY_STAGE_COUNT
+};
+
+// The min, average and 99th percentile time of a stage over the frames in the ring buffer, in milliseconds
+struct TelemetryStats {
+	float min = 0;
+	float average = 0;
+	float p99 = 0;
+};
+
+// Frame telemetry records how long each stage of every frame took, so we can see where the frame time goes. Each frame is stored in a ring buffer
+// that always holds the last TELEMETRY_FRAME_COUNT frames. Timing a stage is just grabbing the performance counter before it and passing it to
+// addStageTime() afterwards, so it's cheap enough to leave on all the time
+class FrameTelemetry
+{
+public:
+	FrameTelemetry();
+
+	// Starts timing a new frame
+	void beginFrame();
+	// Stores the frame that was being timed in the ring buffer
+	void endFrame();
+	// Adds the time since stageStartTime (from SDL_GetPerformanceCounter) to a stage. A stage can be added to more than once per frame, like the
+	// physics step when there is more than one simulation step in a frame
+	void addStageTime(TelemetryStage stage, Uint64 stageStartTime);
+
+	// Works out the stats of a stage. Pass TELEMETRY_STAGE_COUNT to get the stats for the whole frame
+	TelemetryStats getStats(int stage);
+	// Writes every frame in the ring buffer to a CSV file, oldest first. Returns false if the file couldn't be written
+	bool writeCSV(string filename);
+
+	static const char* getStageName(int stage);
+
+private:
+	struct FrameSample {
+		unsigned long frameNumber;
+		float frameTime;
+		float stageTimes[TELEMETRY_STAGE_COUNT];
+	};
+
+	FrameSample samples[TELEMETRY_FRAME_COUNT];
+	// Where the next frame goes in the ring buffer, and how many frames have been recorded in total
+	int nextSample = 0;
+	unsigned long recordedFrames = 0;
+
+	// The frame that is currently being timed
+	FrameSample currentSample;
+	Uint64 frameStartTime = 0;
+
+	// Milliseconds per performance counter tick
+	double counterToMilliseconds;
+
+	// How many frames in the ring buffer have been filled in
+	int getSampleCount() { return (int)min(recordedFrames, (unsigned long)TELEMETRY_FRAME_COUNT); }
+};
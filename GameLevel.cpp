@@ -5,136 +5,505 @@ GameLevel::GameLevel() {}
 void GameLevel::destroy() {
 	SDL_Log("%s", "Game level deconstructor called");
 
-	// Finally we can loop through each tileset and release the memory taken by the textures
-	for (auto tileset : tilesets) {
-		printf("Destroying tileset texture\n");
-		SDL_DestroyTexture(tileset.second.second);
-		tileset.second.second = NULL;
-	}
+	unload();
 }
 
-// Loads the map and its tileset. Returns false if the map couldn't be loaded
-bool GameLevel::load(int screenWidth, int screenHeight, int tileSize, SDL_Renderer* ren, const char* mapFilename, string mapDirectory, b2World* world) {
+void GameLevel::setup(int screenWidth, int screenHeight, int tileSize, SDL_Renderer* ren, SpriteBatch* batch, TextureAtlas* atlas, bool forceStreaming) {
+	this->forceStreaming = forceStreaming;
 	SCREEN_WIDTH = screenWidth;
 	SCREEN_HEIGHT = screenHeight;
 	this->tileSize = tileSize;
 	renderer = ren;
+	spriteBatch = batch;
+	textureAtlas = atlas;
+}
 
-	// We cant just use map.load because it uses standard ifstream instead of SDL's rwops. This means it cant read from the assets on an android device.
-	// Instead, we use SDL_RWops to read the map into a buffer, convert it to a string and then load the map from that string.
-	SDL_RWops* mapFile = SDL_RWFromFile(mapFilename, "r");
-	cout << "buf size for map: " << mapFile->size(mapFile) << endl;
-	char* mapFileBuffer = new char[mapFile->size(mapFile)];
-	SDL_RWread(mapFile, mapFileBuffer, mapFile->size(mapFile), 1);
-	SDL_RWclose(mapFile);
-
-	string mapFileString = string(mapFileBuffer);
-	delete[] mapFileBuffer;
-
-	tmx::Map tiledMap;
-	if (tiledMap.loadFromString(mapFileString, "") == false) {
-		// Check for unsuccesful map load
-		std::cout << "Failed to load map" << endl;
+bool GameLevel::load(string mapFilename, string mapDirectory, bool loadTMX) {
+	if (!prepare(mapFilename, mapDirectory, loadTMX)) {
+		unload();
 		return false;
 	}
 
+	return finishLoading();
+}
+
+// Reads the map and decodes its tileset images. This runs on a loading thread, so it can only touch the pending members
+bool GameLevel::prepare(string mapFilename, string mapDirectory, bool loadTMX) {
+	PROFILE_FUNCTION();
+
+	// The compiled level is much faster to load, but if there isn't one (or we want to see changes made in Tiled straight away) then the .tmx file is used
+	pendingLevelData = LevelData();
+	if (loadTMX || !loadCompiledLevel((mapFilename + ".lvl").c_str(), &pendingLevelData)) {
+		pendingLevelData = LevelData();
+		if (!loadLevelFromTMX((mapFilename + ".tmx").c_str(), mapDirectory, &pendingLevelData))
+			return false;
+	}
+
+	// Merge the solid hitboxes that touch or overlap. This is done here so it happens on the loading thread. Streamed levels only merge within each
+	// chunk, so that evicting a chunk still takes its hitboxes out of the physics world
+	HitboxStats hitboxesBefore = getStaticHitboxStats(pendingLevelData.objects);
+	mergeStaticHitboxes(&pendingLevelData.objects, shouldStream(pendingLevelData.width, pendingLevelData.height) ? CHUNK_SIZE * TILE_SOURCE_SIZE : 0);
+	HitboxStats hitboxesAfter = getStaticHitboxStats(pendingLevelData.objects);
+	SDL_Log("Merged the static hitboxes of %s from %d fixtures (%d broadphase proxies) to %d fixtures (%d broadphase proxies)", mapFilename.c_str(),
+		hitboxesBefore.fixtures, hitboxesBefore.proxies, hitboxesAfter.fixtures, hitboxesAfter.proxies);
+
+	// The objects are turned into spawn records once here, so starting the level doesn't have to go through their strings and properties
+	createSpawnRecords(pendingLevelData.objects, pendingLevelData.height);
+	pendingLevelData.objects.clear();
+
+	// Decoding the images is the slowest part of loading a level, so it is done here instead of when the tilesets are packed. Most levels share the
+	// same tileset, so images that are already in the atlas aren't decoded again and are left as NULL
+	for (LevelTileset& tileset : pendingLevelData.tilesets) {
+		tileset.imagePath = TextureAtlas::normalizeImageName(tileset.imagePath);
+		cout << "Tileset image path: " << tileset.imagePath << endl;
+
+		if (textureAtlas->hasImage(tileset.imagePath))
+			pendingTilesetImages.push_back(NULL);
+		else
+			pendingTilesetImages.push_back(TextureAtlas::loadImage(tileset.imagePath));
+	}
+
+	return true;
+}
+
+// Packs the tilesets into the atlas and bakes the chunks. This needs the renderer so it has to run on the main thread
+bool GameLevel::finishLoading() {
+	PROFILE_FUNCTION();
+
 	// Save the dimensions for rendering
-	width = tiledMap.getTileCount().x;
-	height = tiledMap.getTileCount().y;
+	width = pendingLevelData.width;
+	height = pendingLevelData.height;
 
 	// Loop through all of the tilesets
-	auto& mapTilesets = tiledMap.getTilesets();
-	for (auto& tileset : mapTilesets) {
-		// Only use this tileset if the tileset is a single image - not supporting collection of images right now
-		if (tileset.getImagePath() == "")
-			continue;
+	for (int i = 0; i < pendingLevelData.tilesets.size(); i++) {
+		LevelTileset& tileset = pendingLevelData.tilesets[i];
+		SDL_Surface* tilesetImage = pendingTilesetImages[i];
+
+		// Pack the image into the atlas. If the image wasn't decoded then it should already be in the atlas, but it could have been released since
+		// prepare() checked, or it couldn't be loaded. addImage() takes care of both of those by loading it here if it needs to
+		AtlasRegion tilesetRegion;
+		bool packed;
+		if (tilesetImage != NULL) {
+			packed = textureAtlas->addSurface(tileset.imagePath, tilesetImage, &tilesetRegion);
+			SDL_FreeSurface(tilesetImage);
+			pendingTilesetImages[i] = NULL;
+		}
+		else
+			packed = textureAtlas->addImage(tileset.imagePath, &tilesetRegion);
+		if (!packed) continue;
 
-		cout << "Tileset image path: " << (mapDirectory + tileset.getProperties()[0].getStringValue()).c_str() << endl;
+		// The level now holds a reference to the image, which it gives back when it is unloaded
+		atlasImages.push_back(tileset.imagePath);
 
-		// Load the image and then create the texture it
-		SDL_Surface* surface = IMG_Load((mapDirectory + tileset.getProperties()[0].getStringValue()).c_str());
-		// Add the tileset texture to the map
-		tilesets.insert(make_pair(tileset.getFirstGID(), make_pair(tileset.getLastGID(), SDL_CreateTextureFromSurface(renderer, surface))));
-		// We can free the unused surface as we no longer need it (because we have a texture)
-		SDL_FreeSurface(surface);
+		// Work out the source rect of every tile in the tileset now, so the rest of the level never has to search for its tileset
+		addTilesetSprites(tileset.firstGID, tileset.lastGID, tilesetRegion);
+	}
+	pendingTilesetImages.clear();
+
+	// The objects from the "collisions" layer hold the hitboxes for the level
+	hitboxSpawns = move(pendingHitboxSpawns);
+	spawnVertices = move(pendingSpawnVertices);
+	fixtureTags = move(pendingFixtureTags);
+
+	// Entities and platforms whose tile isn't in a tileset can't be drawn, so they are left out. The tiles are only known now, so the buttons have
+	// to be moved onto the new indexes of the platforms that are left
+	entitySpawns.clear();
+	vector<int> newPlatformIndices;
+	int keptPlatforms = 0;
+	for (const EntitySpawn& spawn : pendingEntitySpawns) {
+		bool valid = isValidTile(spawn.spriteIndex);
+		if (spawn.movingPlatform)
+			newPlatformIndices.push_back(valid ? keptPlatforms++ : -1);
+		if (valid)
+			entitySpawns.push_back(spawn);
+	}
+	pendingEntitySpawns.clear();
+	for (FixtureTag& tag : fixtureTags) {
+		if (tag.kind == FixtureKind::BUTTON && tag.linkedID >= 0)
+			tag.linkedID = newPlatformIndices[tag.linkedID];
 	}
 
-	// Loop through all of the layers
-	auto& mapLayers = tiledMap.getLayers();
-	for (auto& layer : mapLayers) {
+	for (vector<Uint32>& layerTiles : pendingLevelData.tileLayers) {
+		// Empty cells keep a tileset GID of 0
+		TileLayer tileLayer;
+		tileLayer.cells.resize(width * height, 0);
 
-		// The "collisions" object layer holds the hitboxes for the level
-		if (layer->getName() == "collisions" && layer->getType() == tmx::Layer::Type::Object)
-			collisionObjects = layer->getLayerAs<tmx::ObjectGroup>().getObjects();
+		// Now we can loop through all of the tiles in this layer
+		for (int i = 0; i < width * height; i++) {
+			Uint32 tileGID = layerTiles[i];
 
-		// We're only looking to add hitboxes to the tiles on the map, so if this layer isn't a tile layer, we'll move on.
-		if (layer->getType() != tmx::Layer::Type::Tile)
-			continue;
+			// If we didn't find a valid tileset then skip the tile. This also skips empty tiles which have a GID of 0
+			if (!isValidTile(tileGID)) continue;
 
-		// Get all of this layer's tiles.
-		auto& layerTiles = layer->getLayerAs<tmx::TileLayer>().getTiles();
+			// Now that everything checks out, we can add this tile to its place in the grid
+			tileLayer.cells[i] = tileGID;
+		}
 
-		// Now we can loop through all of the tiles in this layer
-		for (int y = 0; y < height; y++) {
-			for (int x = 0; x < width; x++) {
-				uint32_t tileGID = layerTiles[y * width + x].ID;
+		tileLayers.push_back(tileLayer);
+	}
 
-				// If the GID is zero then its an empty tile so we dont want to do anything with it. We can skip to the next tile
-				if (tileGID == 0) continue;
+	// The level data has all been copied out now
+	pendingLevelData = LevelData();
+
+	// Split the map into chunks. They are baked below, or as they come near the camera if the level is streamed
+	chunkColumns = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	chunkRows = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	for (int chunkY = 0; chunkY < chunkRows; chunkY++) {
+		for (int chunkX = 0; chunkX < chunkColumns; chunkX++)
+			chunks.push_back({ chunkX, chunkY, NULL, false, false });
+	}
+
+	staticObjectBodies.resize(hitboxSpawns.size(), NULL);
+	streaming = shouldStream(width, height);
+	if (streaming) {
+		SDL_Log("Streaming a level with %d chunks", (int)chunks.size());
+		findObjectChunks();
+	}
+
+	loaded = true;
+
+	// All of the tiles are static, so we can render them into the chunk textures once now instead of every frame
+	bakeChunks();
+
+	return true;
+}
+
+void GameLevel::unload() {
+	// The tileset textures are owned by the texture atlas and might be shared with other levels, so the level only destroys its chunk textures and
+	// gives back its references to the tilesets
+	destroyChunkTextures();
+	chunks.clear();
+	chunkColumns = 0;
+	chunkRows = 0;
+	activeChunks.clear();
+	chunkObjects.clear();
+	objectChunkRanges.clear();
+	staticObjectBodies.clear();
+	physicsWorld = NULL;
+	streaming = false;
+
+	for (string& imageName : atlasImages)
+		textureAtlas->releaseImage(imageName);
+	atlasImages.clear();
+
+	// If the level was unloaded part way through loading then the decoded images might still be here
+	for (SDL_Surface* tilesetImage : pendingTilesetImages) {
+		if (tilesetImage != NULL)
+			SDL_FreeSurface(tilesetImage);
+	}
+	pendingTilesetImages.clear();
+	pendingLevelData = LevelData();
+
+	width = 0;
+	height = 0;
+	tileLayers.clear();
+	tileSprites.clear();
+	pendingHitboxSpawns.clear();
+	pendingEntitySpawns.clear();
+	pendingSpawnVertices.clear();
+	hitboxSpawns.clear();
+	entitySpawns.clear();
+	spawnVertices.clear();
+	pendingFixtureTags.clear();
+	fixtureTags.clear();
+	entities.clear();
+	movingPlatforms.clear();
+	initialEntities.clear();
+	entityTemplates.clear();
+	movingPlatformTemplates.clear();
+	loaded = false;
+}
+
+void GameLevel::bakeChunks() {
+	PROFILE_FUNCTION();
+
+	// If the chunks were already baked then we need to get rid of the old textures first
+	destroyChunkTextures();
+
+	// Levels that aren't loaded don't have any tiles to bake
+	if (!loaded) return;
+
+	// Some renderers can't render to textures. If that's the case then the chunks stay unbaked and render() will draw the tiles one by one
+	canBakeChunks = SDL_RenderTargetSupported(renderer) == SDL_TRUE;
+	if (!canBakeChunks) {
+		SDL_Log("Render targets aren't supported. Tiles will be rendered individually");
+		return;
+	}
+
+	// Streamed levels bake their chunks in updateStreaming() as the camera gets near them
+	if (streaming) return;
+
+	for (TileChunk& chunk : chunks) {
+		if (!bakeChunk(chunk)) {
+			// If one chunk can't be made then none of them can be trusted, so we go back to rendering the tiles individually
+			SDL_SetRenderTarget(renderer, NULL);
+			destroyChunkTextures();
+			canBakeChunks = false;
+			return;
+		}
+	}
+
+	// Go back to rendering on the window
+	SDL_SetRenderTarget(renderer, NULL);
+}
+
+bool GameLevel::bakeChunk(TileChunk& chunk) {
+	// The tiles in this chunk. The chunks on the right and bottom edges might not be full
+	int firstX = chunk.x * CHUNK_SIZE;
+	int firstY = chunk.y * CHUNK_SIZE;
+	int lastX = min(firstX + CHUNK_SIZE, width) - 1;
+	int lastY = min(firstY + CHUNK_SIZE, height) - 1;
+
+	// There is no point making a texture for a chunk without any tiles
+	bool chunkHasTiles = false;
+	for (TileLayer& layer : tileLayers) {
+		for (int y = firstY; y <= lastY && !chunkHasTiles; y++) {
+			for (int x = firstX; x <= lastX && !chunkHasTiles; x++)
+				chunkHasTiles = layer.cells[y * width + x] != 0;
+		}
+	}
+
+	if (!chunkHasTiles) {
+		chunk.baked = true;
+		return true;
+	}
 
-				// This will hold the first GID of the tileset that this tile belongs to. If it changes from -1, then we have found a tileset
-				int tset_gid = -1;
-				SDL_Rect spriteRect;
-				// If we didn't find a valid tileset then skip the tile
-				if (!getTileSourceRect(tileGID, &tset_gid, &spriteRect)) continue;
+	chunk.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, CHUNK_SIZE * TILE_SOURCE_SIZE, CHUNK_SIZE * TILE_SOURCE_SIZE);
+	if (chunk.texture == NULL) {
+		SDL_Log("Couldn't create a chunk texture, tiles will be rendered individually. SDL Error: %s", SDL_GetError());
+		return false;
+	}
+
+	// The chunk needs to be transparent where there aren't any tiles so the background can be seen through it
+	SDL_SetTextureBlendMode(chunk.texture, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderTarget(renderer, chunk.texture);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+
+	// The layers are drawn in order so that the upper layers are on top
+	for (TileLayer& layer : tileLayers) {
+		for (int y = firstY; y <= lastY; y++) {
+			for (int x = firstX; x <= lastX; x++) {
+				Uint32 tileGID = layer.cells[y * width + x];
+				if (tileGID == 0) continue;
 
-				// Now that everything checks out, we can add this tile to the tiles vector
-				Tile tile = { tset_gid, x, y, spriteRect};
-				tiles.push_back(tile);
+				TileSprite& tile = tileSprites[tileGID];
+				SDL_Rect destinationRect = { (x - firstX) * TILE_SOURCE_SIZE, (y - firstY) * TILE_SOURCE_SIZE, TILE_SOURCE_SIZE, TILE_SOURCE_SIZE };
+				SDL_RenderCopy(renderer, tile.texture, &tile.spriteRect, &destinationRect);
 			}
 		}
 	}
 
+	chunk.baked = true;
 	return true;
 }
 
-bool GameLevel::getTileSourceRect(int tileGID, int* tset_gid, SDL_Rect* outputRect) {
-	for (auto ts : tilesets) {
-		if (tileGID >= ts.first && tileGID <= ts.second.first) {
-			*tset_gid = ts.first;
-			break;
+void GameLevel::destroyChunkTextures() {
+	for (TileChunk& chunk : chunks) {
+		if (chunk.texture != NULL)
+			SDL_DestroyTexture(chunk.texture);
+		chunk.texture = NULL;
+		chunk.baked = false;
+	}
+}
+
+bool GameLevel::shouldStream(int levelWidth, int levelHeight) {
+	int chunkCount = ((levelWidth + CHUNK_SIZE - 1) / CHUNK_SIZE) * ((levelHeight + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	return forceStreaming || chunkCount > STREAMING_MIN_CHUNKS;
+}
+
+void GameLevel::findObjectChunks() {
+	objectChunkRanges.resize(hitboxSpawns.size(), { 0, 0, -1, -1 });
+	chunkObjects.resize(chunks.size());
+
+	// Entities and moving platforms move between chunks, so they are always in the world. Only the hitboxes are streamed
+	for (int i = 0; i < hitboxSpawns.size(); i++) {
+		const HitboxSpawn& spawn = hitboxSpawns[i];
+
+		// The bounding box of the hitbox in tiles, with y going down like the chunks do
+		float left = spawnVertices[spawn.firstVertex].x, right = left;
+		float top = height - spawnVertices[spawn.firstVertex].y, bottom = top;
+		for (int v = spawn.firstVertex; v < spawn.firstVertex + spawn.vertexCount; v++) {
+			left = min(left, spawnVertices[v].x);
+			right = max(right, spawnVertices[v].x);
+			top = min(top, height - spawnVertices[v].y);
+			bottom = max(bottom, height - spawnVertices[v].y);
+		}
+
+		// The chunks that the bounding box touches. x and y are the first chunk, and w and h are the last chunk (not the size)
+		SDL_Rect range;
+		range.x = max(0, min(chunkColumns - 1, (int)floor(left / CHUNK_SIZE)));
+		range.w = max(0, min(chunkColumns - 1, (int)floor(right / CHUNK_SIZE)));
+		range.y = max(0, min(chunkRows - 1, (int)floor(top / CHUNK_SIZE)));
+		range.h = max(0, min(chunkRows - 1, (int)floor(bottom / CHUNK_SIZE)));
+		objectChunkRanges[i] = range;
+
+		for (int chunkY = range.y; chunkY <= range.h; chunkY++) {
+			for (int chunkX = range.x; chunkX <= range.w; chunkX++)
+				chunkObjects[chunkY * chunkColumns + chunkX].push_back(i);
 		}
 	}
+}
 
-	// If we didn't find a valid tileset, skip the tile.
-	if (*tset_gid == -1) return false;
-	tileGID -= *tset_gid;
+void GameLevel::updateStreaming(float camXOffset, float camYOffset) {
+	if (!streaming) return;
 
-	// Get the dimensions of the tileset to figure out the source rect for the tile
-	int tsWidth = 0;
-	SDL_QueryTexture(tilesets[*tset_gid].second, NULL, NULL, &tsWidth, NULL);
+	PROFILE_FUNCTION();
 
-	// Since the tile texture is just one tile in the sprite sheet, we need to create a rect to extract it
-	*outputRect = { (tileGID % (tsWidth / 32)) * 32, (tileGID / (tsWidth / 32)) * 32, 32, 32 };
+	int firstColumn, lastColumn, firstRow, lastRow;
+	getVisibleCells(CHUNK_SIZE * tileSize, chunkColumns, chunkRows, camXOffset, camYOffset, &firstColumn, &lastColumn, &firstRow, &lastRow);
 
-	return true;
+	// Evict the chunks that are too far from the screen. This is a bigger distance than the load radius so that a chunk that was just loaded isn't
+	// evicted again as soon as the camera moves back a bit
+	for (int i = 0; i < activeChunks.size();) {
+		TileChunk& chunk = chunks[activeChunks[i]];
+		int distance = max(max(firstColumn - chunk.x, chunk.x - lastColumn), max(firstRow - chunk.y, chunk.y - lastRow));
+		if (distance > STREAMING_UNLOAD_RADIUS) {
+			deactivateChunk(activeChunks[i]);
+			activeChunks[i] = activeChunks.back();
+			activeChunks.pop_back();
+		}
+		else
+			i++;
+	}
+
+	// Load the chunks on the screen and around it
+	int firstLoadedColumn = max(0, firstColumn - STREAMING_LOAD_RADIUS);
+	int lastLoadedColumn = min(chunkColumns - 1, lastColumn + STREAMING_LOAD_RADIUS);
+	int firstLoadedRow = max(0, firstRow - STREAMING_LOAD_RADIUS);
+	int lastLoadedRow = min(chunkRows - 1, lastRow + STREAMING_LOAD_RADIUS);
+	for (int chunkY = firstLoadedRow; chunkY <= lastLoadedRow; chunkY++) {
+		for (int chunkX = firstLoadedColumn; chunkX <= lastLoadedColumn; chunkX++) {
+			if (!chunks[chunkY * chunkColumns + chunkX].active)
+				activateChunk(chunkY * chunkColumns + chunkX);
+		}
+	}
+
+	// Bake a few of the loaded chunks. The ones on the screen go first since they're the ones being drawn tile by tile right now
+	if (canBakeChunks) {
+		int bakedChunks = 0;
+		for (int pass = 0; pass < 2 && bakedChunks < STREAMING_BAKES_PER_FRAME && canBakeChunks; pass++) {
+			for (int chunkIndex : activeChunks) {
+				TileChunk& chunk = chunks[chunkIndex];
+				bool onScreen = chunk.x >= firstColumn && chunk.x <= lastColumn && chunk.y >= firstRow && chunk.y <= lastRow;
+				if (chunk.baked || (pass == 0 && !onScreen)) continue;
+
+				if (!bakeChunk(chunk)) {
+					canBakeChunks = false;
+					break;
+				}
+
+				bakedChunks++;
+				if (bakedChunks == STREAMING_BAKES_PER_FRAME) break;
+			}
+		}
+
+		// Go back to rendering on the window
+		if (bakedChunks > 0 || !canBakeChunks)
+			SDL_SetRenderTarget(renderer, NULL);
+	}
+
+	// Entities that wander out of the loaded chunks would fall through the ground that isn't there, so they are frozen until their chunk is loaded again
+	for (Entity& entity : entities) {
+		b2Vec2 position = entity.entityBody->GetPosition();
+		int chunkX = (int)floor(position.x / CHUNK_SIZE);
+		int chunkY = (int)floor((height - position.y) / CHUNK_SIZE);
+		if (chunkX < 0 || chunkX >= chunkColumns || chunkY < 0 || chunkY >= chunkRows) continue;
+
+		bool enabled = chunks[chunkY * chunkColumns + chunkX].active;
+		if (entity.entityBody->IsEnabled() != enabled)
+			entity.entityBody->SetEnabled(enabled);
+	}
 }
 
-void GameLevel::render(float camXOffset, float camYOffset) {
-	for (Tile tile : tiles) {
-		// Creating a rectangle for the tiles destination on the screen. Since we have a camera, we need to subtract the camera offset to give a scrolling effect
-		SDL_Rect destinationRect = { (int)(tile.x * tileSize - camXOffset), (int)(SCREEN_HEIGHT - (height * tileSize - tile.y * tileSize) - camYOffset), tileSize, tileSize };
+void GameLevel::activateChunk(int chunkIndex) {
+	chunks[chunkIndex].active = true;
+	activeChunks.push_back(chunkIndex);
+	createChunkHitboxes(chunkIndex);
+}
 
-		// We can skip rendering the tile if it is outside the camera as we wont be seeing it anyway
-		if (isTileInRect(&destinationRect) == false)
-			// Skip this tile
-			continue;
+void GameLevel::deactivateChunk(int chunkIndex) {
+	TileChunk& chunk = chunks[chunkIndex];
+	chunk.active = false;
+
+	if (chunk.texture != NULL)
+		SDL_DestroyTexture(chunk.texture);
+	chunk.texture = NULL;
+	chunk.baked = false;
+
+	if (physicsWorld == NULL) return;
 
-		SDL_RenderCopy(renderer, tilesets[tile.tilesetGID].second, &tile.spriteRect, &destinationRect);
+	// An object that covers more than one chunk stays in the world until all of its chunks are evicted
+	for (int objectIndex : chunkObjects[chunkIndex]) {
+		if (staticObjectBodies[objectIndex] == NULL) continue;
+
+		const SDL_Rect& range = objectChunkRanges[objectIndex];
+		bool stillNeeded = false;
+		for (int chunkY = range.y; chunkY <= range.h && !stillNeeded; chunkY++) {
+			for (int chunkX = range.x; chunkX <= range.w && !stillNeeded; chunkX++)
+				stillNeeded = chunks[chunkY * chunkColumns + chunkX].active;
+		}
+
+		if (!stillNeeded) {
+			physicsWorld->DestroyBody(staticObjectBodies[objectIndex]);
+			staticObjectBodies[objectIndex] = NULL;
+		}
+	}
+}
+
+void GameLevel::createChunkHitboxes(int chunkIndex) {
+	if (physicsWorld == NULL) return;
+
+	for (int objectIndex : chunkObjects[chunkIndex]) {
+		if (staticObjectBodies[objectIndex] == NULL)
+			staticObjectBodies[objectIndex] = createStaticHitbox(hitboxSpawns[objectIndex], physicsWorld);
+	}
+}
+
+void GameLevel::addTilesetSprites(int firstGID, int lastGID, const AtlasRegion& tilesetRegion) {
+	if (lastGID >= (int)tileSprites.size())
+		tileSprites.resize(lastGID + 1, { NULL, { 0, 0, 0, 0 } });
+
+	// The number of tiles in each row of the tileset image
+	int columns = tilesetRegion.rect.w / TILE_SOURCE_SIZE;
+	if (columns < 1) return;
+
+	for (int tileGID = firstGID; tileGID <= lastGID; tileGID++) {
+		// Since the tile texture is just one tile in the sprite sheet, we need to create a rect to extract it. The tileset is somewhere in an atlas page,
+		// so the rect is moved to where the tileset is
+		int localID = tileGID - firstGID;
+		tileSprites[tileGID].texture = tilesetRegion.texture;
+		tileSprites[tileGID].spriteRect = tilesetRegion.getSourceRect((localID % columns) * TILE_SOURCE_SIZE, (localID / columns) * TILE_SOURCE_SIZE, TILE_SOURCE_SIZE, TILE_SOURCE_SIZE);
+	}
+}
+
+void GameLevel::render(float camXOffset, float camYOffset, float interpolation) {
+	PROFILE_FUNCTION();
+
+	int firstColumn, lastColumn, firstRow, lastRow;
+
+	// Only the chunks that the camera can see are drawn. Baked chunks already have all of their tiles in them, and the ones that aren't baked
+	// (because the renderer can't render to textures or the level is streamed and hasn't got to them yet) are drawn tile by tile
+	getVisibleCells(CHUNK_SIZE * tileSize, chunkColumns, chunkRows, camXOffset, camYOffset, &firstColumn, &lastColumn, &firstRow, &lastRow);
+
+	for (int chunkY = firstRow; chunkY <= lastRow; chunkY++) {
+		for (int chunkX = firstColumn; chunkX <= lastColumn; chunkX++) {
+			TileChunk& chunk = chunks[chunkY * chunkColumns + chunkX];
+
+			if (chunk.texture != NULL) {
+				// Same as the tile destination below, but a chunk is CHUNK_SIZE tiles wide and high
+				SDL_Rect destinationRect = { (int)(chunk.x * CHUNK_SIZE * tileSize - camXOffset), (int)(SCREEN_HEIGHT - (height * tileSize - chunk.y * CHUNK_SIZE * tileSize) - camYOffset), CHUNK_SIZE * tileSize, CHUNK_SIZE * tileSize };
+				spriteBatch->draw(chunk.texture, NULL, &destinationRect);
+			}
+			// Baked chunks without a texture are empty
+			else if (!chunk.baked)
+				renderChunkTiles(chunk, camXOffset, camYOffset);
+		}
 	}
 
 	for (Entity& entity : entities) {
-		b2Vec2 entityPos = entity.entityBody->GetPosition();
+		b2Vec2 entityPos = entity.previousPosition + interpolation * (entity.entityBody->GetPosition() - entity.previousPosition);
+		float entityAngle = entity.previousAngle + interpolation * (entity.entityBody->GetAngle() - entity.previousAngle);
 
 		// Creating a rectangle for the tiles destination on the screen. Since we have a camera, we need to subtract the camera offset to give a scrolling effect
 		SDL_Rect destinationRect = { (int)((entityPos.x - 0.5) * tileSize - camXOffset), (int)(SCREEN_HEIGHT - ((entityPos.y + 0.5) * tileSize) - camYOffset), tileSize, tileSize };
@@ -144,13 +513,13 @@ void GameLevel::render(float camXOffset, float camYOffset) {
 			// Skip this tile
 			continue;
 
-		SDL_RenderCopyEx(renderer, tilesets[entity.tilesetGID].second, &entity.spriteRect, &destinationRect, (double)entity.entityBody->GetAngle() * -180.0 / b2_pi, NULL, SDL_FLIP_NONE);
+		TileSprite& sprite = tileSprites[entity.spriteIndex];
+		spriteBatch->draw(sprite.texture, &sprite.spriteRect, &destinationRect, (double)entityAngle * -180.0 / b2_pi);
 	}
 
-	for (auto platformIDPair : movingPlatforms) {
-		MovingPlatform platform = platformIDPair.second;
-
-		b2Vec2 entityPos = platform.entityBody->GetPosition();
+	for (int i = 0; i < movingPlatforms.size(); i++) {
+		b2Vec2 previousPosition(movingPlatforms.previousX[i], movingPlatforms.previousY[i]);
+		b2Vec2 entityPos = previousPosition + interpolation * (movingPlatforms.bodies[i]->GetPosition() - previousPosition);
 
 		// Creating a rectangle for the tiles destination on the screen. Since we have a camera, we need to subtract the camera offset to give a scrolling effect
 		SDL_Rect destinationRect = { (int)((entityPos.x - 0.5) * tileSize - camXOffset), (int)(SCREEN_HEIGHT - ((entityPos.y + 0.5) * tileSize) - camYOffset), tileSize, tileSize };
@@ -163,13 +532,49 @@ void GameLevel::render(float camXOffset, float camYOffset) {
 		}
 
 		//cout << "Rendering moving platform at x=" << destinationRect.x << endl;
-		SDL_RenderCopy(renderer, tilesets[platform.tilesetGID].second, &platform.spriteRect, &destinationRect);
+		TileSprite& sprite = tileSprites[movingPlatforms.spriteIndices[i]];
+		spriteBatch->draw(sprite.texture, &sprite.spriteRect, &destinationRect);
+	}
+}
+
+void GameLevel::renderChunkTiles(const TileChunk& chunk, float camXOffset, float camYOffset) {
+	int firstX = chunk.x * CHUNK_SIZE;
+	int firstY = chunk.y * CHUNK_SIZE;
+	int lastX = min(firstX + CHUNK_SIZE, width) - 1;
+	int lastY = min(firstY + CHUNK_SIZE, height) - 1;
+
+	for (TileLayer& layer : tileLayers) {
+		for (int y = firstY; y <= lastY; y++) {
+			for (int x = firstX; x <= lastX; x++) {
+				Uint32 tileGID = layer.cells[y * width + x];
+				if (tileGID == 0) continue;
+
+				TileSprite& tile = tileSprites[tileGID];
+
+				// Creating a rectangle for the tiles destination on the screen. Since we have a camera, we need to subtract the camera offset to give a scrolling effect
+				SDL_Rect destinationRect = { (int)(x * tileSize - camXOffset), (int)(SCREEN_HEIGHT - (height * tileSize - y * tileSize) - camYOffset), tileSize, tileSize };
+				spriteBatch->draw(tile.texture, &tile.spriteRect, &destinationRect);
+			}
+		}
+	}
+}
+
+void GameLevel::savePreviousTransforms() {
+	for (Entity& entity : entities) {
+		entity.previousPosition = entity.entityBody->GetPosition();
+		entity.previousAngle = entity.entityBody->GetAngle();
+	}
+
+	for (int i = 0; i < movingPlatforms.size(); i++) {
+		b2Vec2 position = movingPlatforms.bodies[i]->GetPosition();
+		movingPlatforms.previousX[i] = position.x;
+		movingPlatforms.previousY[i] = position.y;
 	}
 }
 
 bool GameLevel::isTileInRect(SDL_Rect* tileRect) {
 	// Here we are comparing the borders of the tile to the window borders
-	if (tileRect->x + tileSize < 0 || tileRect->x > SCREEN_WIDTH || tileRect->y + tileSize < 0 || tileRect->y > SCREEN_HEIGHT) {
+	if (tileRect->x + tileRect->w < 0 || tileRect->x > SCREEN_WIDTH || tileRect->y + tileRect->h < 0 || tileRect->y > SCREEN_HEIGHT) {
 		// If the sides of the tile are outside the window's sides, then this tile must be outside of the window (obviously)
 		return false;
 	}
@@ -178,267 +583,544 @@ bool GameLevel::isTileInRect(SDL_Rect* tileRect) {
 	return true;
 }
 
+void GameLevel::getVisibleCells(int cellSize, int columns, int rows, float camXOffset, float camYOffset, int* firstColumn, int* lastColumn, int* firstRow, int* lastRow) {
+	// The top of the map is height tiles above the bottom of the screen (before the camera offset is taken into account)
+	float gridTop = SCREEN_HEIGHT - height * tileSize - camYOffset;
+
+	// Any cell that is partly on the screen counts as visible
+	*firstColumn = max(0, (int)floor(camXOffset / cellSize));
+	*lastColumn = min(columns - 1, (int)floor((camXOffset + SCREEN_WIDTH) / cellSize));
+	*firstRow = max(0, (int)floor(-gridTop / cellSize));
+	*lastRow = min(rows - 1, (int)floor((SCREEN_HEIGHT - gridTop) / cellSize));
+}
+
 void GameLevel::createHitboxes(b2World* world) {
+	PROFILE_FUNCTION();
+
 	// Remove any thingies if they existed from the previous level
 	movingPlatforms.clear();
 	entities.clear();
-
-	for (auto& object : collisionObjects)
-	{
-		// A map of properties is easier to use than a vector
-		unordered_map<string, tmx::Property> objectProperties;
-		for (tmx::Property objectProperty : object.getProperties()) {
-			auto var1 = objectProperty;
-			objectProperties.insert(make_pair(objectProperty.getName(), var1));
+	initialEntities.clear();
+	entityTemplates.clear();
+	movingPlatformTemplates.clear();
+
+	// The bodies from the last time the level was started went with the old world
+	physicsWorld = world;
+	fill(staticObjectBodies.begin(), staticObjectBodies.end(), (b2Body*)NULL);
+
+	// Unless the level is streamed, all of the static hitboxes go on one body at the origin. Bodies cost more than fixtures, and the hitboxes never move anyway.
+	// Streamed levels only make the hitboxes of the chunks near the camera, which is done below and in updateStreaming()
+	if (!streaming) {
+		b2BodyDef levelBodyDef;
+		levelBodyDef.type = b2_staticBody;
+		b2Body* levelBody = world->CreateBody(&levelBodyDef);
+
+		for (int i = 0; i < hitboxSpawns.size(); i++) {
+			addStaticFixture(hitboxSpawns[i], levelBody);
+			staticObjectBodies[i] = levelBody;
 		}
 
-		if (object.getType() == "entity" || object.getType() == "mp") {
-			createEntity(&object, world, object.getType() == "mp", objectProperties);
-			continue;
-		}
+		SDL_Log("Created the level body with %d fixtures. The physics world has %d broadphase proxies", (int)hitboxSpawns.size(), world->GetProxyCount());
+	}
+
+	for (int chunkIndex : activeChunks)
+		createChunkHitboxes(chunkIndex);
 
-		b2BodyDef tileBodyDef;
-		tileBodyDef.type = b2_staticBody;
+	for (const EntitySpawn& spawn : entitySpawns)
+		createEntity(spawn);
+	createDynamicBodies();
+}
 
-		tileBodyDef.position.Set(object.getPosition().x / 32, height - (object.getPosition().y / 32));
-		b2Body* tileBody = world->CreateBody(&tileBodyDef);
+void GameLevel::resetDynamicBodies() {
+	PROFILE_FUNCTION();
 
-		const auto& objectPoints = object.getPoints();
-		const int pointCount = (int)(objectPoints.size());
+	for (Entity& entity : entities)
+		physicsWorld->DestroyBody(entity.entityBody);
+	for (b2Body* platformBody : movingPlatforms.bodies)
+		physicsWorld->DestroyBody(platformBody);
 
-		b2Vec2* chainPoints = new b2Vec2[pointCount];
-		for (int i = 0; i < pointCount; i++)
-			chainPoints[i] = b2Vec2(objectPoints[i].x / 32, -1 * objectPoints[i].y / 32);
+	createDynamicBodies();
+}
 
-		b2FixtureDef fixtureDef;
-		b2ChainShape collisionShape;
-		// We need a polygon shape for the finish points on the level
-		b2PolygonShape polygonShape;
+void GameLevel::createDynamicBodies() {
+	entities = initialEntities;
+	for (int i = 0; i < entities.size(); i++)
+		entities[i].entityBody = createDynamicBody(entityTemplates[i]);
 
-		// Make the collision chape from the points
-		collisionShape.CreateLoop(chainPoints, pointCount);
-		fixtureDef.shape = &collisionShape;
+	movingPlatforms.reset();
+	for (int i = 0; i < movingPlatforms.size(); i++) {
+		movingPlatforms.bodies[i] = createDynamicBody(movingPlatformTemplates[i]);
+		movingPlatforms.previousX[i] = movingPlatformTemplates[i].bodyDef.position.x;
+		movingPlatforms.previousY[i] = movingPlatformTemplates[i].bodyDef.position.y;
+	}
+}
 
-		// Ladders should be sensors so that there is no collision response
-		if (object.getType() == "ladder") {
-			fixtureDef.isSensor = true;
-			fixtureDef.userData = (void*)LADDER;
-		}
+b2Body* GameLevel::createDynamicBody(const DynamicBodyTemplate& bodyTemplate) {
+	b2Body* body = physicsWorld->CreateBody(&bodyTemplate.bodyDef);
 
-		else if (object.getType() == "button") {
-			fixtureDef.isSensor = true;
+	b2FixtureDef fixtureDef = bodyTemplate.fixtureDef;
+	fixtureDef.shape = &bodyTemplate.shape;
+	body->CreateFixture(&fixtureDef);
 
-			// We don't want to have platform ids over 100,000. It could be higher, but just stoppig here to be safe. If it goes too high, the
-			// collision handler wont be able to get the correct platform id from the box2d user data
-			if (objectProperties.count("platformID") > 0 && objectProperties["platformID"].getIntValue() < 100000) {
-				int platformUserData = BUTTON * 1000000 + objectProperties["platformID"].getIntValue();
-				fixtureDef.userData = (void*)platformUserData;
-			}	
-		}
+	return body;
+}
 
-		else if(object.getType() == "danger") {
-			// If the tile is dangerous, then we need to add some user data so the collision handler knows
-			fixtureDef.userData = (void*)DANGEROUS_TILE;
-		}
+b2Body* GameLevel::createStaticHitbox(const HitboxSpawn& spawn, b2World* world) {
+	// The points are already in world coordinates, so the body stays at the origin
+	b2BodyDef tileBodyDef;
+	tileBodyDef.type = b2_staticBody;
+	b2Body* tileBody = world->CreateBody(&tileBodyDef);
 
-		// Finish points need to be sensors, but they also need to have an ID and a polygon shape
-		else if (object.getType() == "finish") {
-			fixtureDef.isSensor = true;
-			polygonShape.Set(chainPoints, pointCount);
-			fixtureDef.shape = &polygonShape;
+	addStaticFixture(spawn, tileBody);
 
-			int finishPointUserData = FINISH_POINT * 1000000;
-			if (objectProperties.count("level") > 0)
-				finishPointUserData += objectProperties["level"].getIntValue();
-			fixtureDef.userData = (void*)finishPointUserData;
-		}
+	return tileBody;
+}
 
-		// Now we bind the shape to the body with a fixture
-		tileBody->CreateFixture(&fixtureDef);
+void GameLevel::addStaticFixture(const HitboxSpawn& spawn, b2Body* body) {
+	const b2Vec2* points = &spawnVertices[spawn.firstVertex];
 
-		delete[] chainPoints;
-		chainPoints = NULL;
+	b2FixtureDef fixtureDef;
+	fixtureDef.userData = &fixtureTags[spawn.fixtureTag];
+	fixtureDef.filter = getFixtureFilter(fixtureTags[spawn.fixtureTag].kind);
+	// Ladders, buttons and finish points should be sensors so that there is no collision response
+	fixtureDef.isSensor = spawn.kind == HitboxKind::LADDER_HITBOX || spawn.kind == HitboxKind::BUTTON_HITBOX || spawn.kind == HitboxKind::FINISH_HITBOX;
+
+	// Finish points need a polygon shape, and everything else is a chain loop. Both of them copy the points, so they can come straight out of the arena
+	if (spawn.kind == HitboxKind::FINISH_HITBOX) {
+		b2PolygonShape polygonShape;
+		polygonShape.Set(points, spawn.vertexCount);
+		fixtureDef.shape = &polygonShape;
+		body->CreateFixture(&fixtureDef);
+	}
+	else {
+		b2ChainShape collisionShape;
+		collisionShape.CreateLoop(points, spawn.vertexCount);
+		fixtureDef.shape = &collisionShape;
+		body->CreateFixture(&fixtureDef);
 	}
 }
 
-void GameLevel::createEntity(tmx::Object* entityObject, b2World* world, bool movingPlatform, unordered_map<string, tmx::Property> objectProperties) {
-	MPDirections movementType = MPDirections::NOT_SET;
-	
-	if (movingPlatform) {
-		if (objectProperties.count("direction") < 1) return;
-		movementType = (MPDirections)objectProperties["direction"].getIntValue();
+void GameLevel::createSpawnRecords(const vector<LevelObject>& objects, int levelHeight) {
+	pendingHitboxSpawns.clear();
+	pendingEntitySpawns.clear();
+	pendingSpawnVertices.clear();
+	pendingFixtureTags.clear();
+
+	// Path platforms say which path they follow by its ID
+	unordered_map<Uint32, const LevelObject*> paths;
+	for (const LevelObject& object : objects) {
+		if (object.type == "path")
+			paths[object.uid] = &object;
 	}
 
-	/* We want to exit if the object doent have the right properties, which means one of these:
-	* The rendering things were not set (tile id and center of platform/entity)
-	* The entity is a moving platform but the direction hasn't been set
-	* The entity is a moving platform, but the movement boundaries haven't been set, or they don't correspond correctly to the direction of the platform
-	* The entity is amoving platform, but one of its velocity properties wasn't specified
-	*/
-	if (objectProperties.count("tileGID") < 1 || objectProperties.count("centerX") < 1 || objectProperties.count("centerY") < 1 || movingPlatform && (\
-		(objectProperties.count("boundaryLeft") < 1 || objectProperties.count("boundaryRight") < 1 || objectProperties.count("horizontalVelocity") < 1) && (movementType == MPDirections::HORIZONTAL || movementType == MPDirections::DIAGONAL) ||
-		(objectProperties.count("boundaryTop") < 1 || objectProperties.count("boundaryBottom") < 1 || objectProperties.count("verticalVelocity") < 1) && (movementType == MPDirections::VERTICAL || movementType == MPDirections::DIAGONAL))) {
+	for (const LevelObject& object : objects) {
+		int firstVertex = (int)pendingSpawnVertices.size();
+		int vertexCount = (int)object.points.size();
 
-		// This entity wasn't setup properly in the Tiled editor
-		cout << "NNNNNNNNNNNNNNNNNNAaaaaaaaaaah\nMoving platform: " << movingPlatform << endl;
-		return;
-	}
+		// Paths are only used by the platforms that follow them
+		if (object.type == "path") continue;
 
-	// This will hold the first GID of the tileset that this tile belongs to. If it changes from -1, then we have found a tileset
-	int tset_gid = -1;
-	SDL_Rect spriteRect;
-	// If we didn't find a valid tileset then skip the tile
-	if (!getTileSourceRect(objectProperties["tileGID"].getIntValue(), &tset_gid, &spriteRect)) return;
+		if (object.type == "entity" || object.type == "mp") {
+			bool movingPlatform = object.type == "mp";
+			MPDirections movementType = MPDirections::NOT_SET;
 
-	b2BodyDef entityBodyDef;
-	if (movingPlatform)
-		entityBodyDef.type = b2_kinematicBody;
-	else
-		entityBodyDef.type = b2_dynamicBody;
-	entityBodyDef.position.Set((float)objectProperties["centerX"].getIntValue() / 32, height - (float)objectProperties["centerY"].getIntValue() / 32);
-	b2Body* entityBody = world->CreateBody(&entityBodyDef);
+			if (movingPlatform) {
+				if (!object.hasProperty("direction")) continue;
+				movementType = (MPDirections)object.getIntProperty("direction");
+			}
 
-	const auto& objectPoints = entityObject->getPoints();
-	const int pointCount = (int)(objectPoints.size());
+			/* We want to skip the object if it doesnt have the right properties, which means one of these:
+			* The rendering things were not set (tile id and center of platform/entity)
+			* The entity is a moving platform but the direction hasn't been set
+			* The entity is a moving platform, but the movement boundaries haven't been set, or they don't correspond correctly to the direction of the platform
+			* The entity is amoving platform, but one of its velocity properties wasn't specified
+			*/
+			if (!object.hasProperty("tileGID") || !object.hasProperty("centerX") || !object.hasProperty("centerY") || movingPlatform && (\
+				(!object.hasProperty("boundaryLeft") || !object.hasProperty("boundaryRight") || !object.hasProperty("horizontalVelocity")) && (movementType == MPDirections::HORIZONTAL || movementType == MPDirections::DIAGONAL) ||
+				(!object.hasProperty("boundaryTop") || !object.hasProperty("boundaryBottom") || !object.hasProperty("verticalVelocity")) && (movementType == MPDirections::VERTICAL || movementType == MPDirections::DIAGONAL))) {
+
+				// This entity wasn't setup properly in the Tiled editor
+				cout << "NNNNNNNNNNNNNNNNNNAaaaaaaaaaah\nMoving platform: " << movingPlatform << endl;
+				continue;
+			}
 
-	b2Vec2* chainPoints = new b2Vec2[pointCount];
+			// A path platform needs a path to follow, with at least a start and an end
+			const LevelObject* path = NULL;
+			if (movementType == MPDirections::PATH) {
+				auto pathObject = paths.find((Uint32)object.getIntProperty("path"));
+				if (!object.hasProperty("path") || !object.hasProperty("pathSpeed") || pathObject == paths.end() || pathObject->second->points.size() < 2) {
+					cout << "Moving platform " << object.uid << " needs a path with at least 2 points and a path speed" << endl;
+					continue;
+				}
+				path = pathObject->second;
+			}
 
-	for (int i = 0; i < pointCount; i++)
-		chainPoints[i] = b2Vec2(objectPoints[i].x / 32 - (entityBodyDef.position.x - (entityObject->getPosition().x / 32)), -1 * objectPoints[i].y / 32 - (entityBodyDef.position.y - (height - (entityObject->getPosition().y / 32))));
+			EntitySpawn spawn = {};
+			spawn.uid = object.uid;
+			spawn.movingPlatform = movingPlatform;
+			spawn.fixtureTag = (int)pendingFixtureTags.size();
+			pendingFixtureTags.push_back({ movingPlatform ? FixtureKind::MOVING_PLATFORM : FixtureKind::ENTITY, (int)object.uid, (int)pendingEntitySpawns.size() });
+			spawn.spriteIndex = (Uint32)object.getIntProperty("tileGID");
+			spawn.center.Set((float)object.getIntProperty("centerX") / 32, levelHeight - (float)object.getIntProperty("centerY") / 32);
+			spawn.firstVertex = firstVertex;
+			spawn.vertexCount = vertexCount;
+
+			// The points are relative to the object, but the body goes at the center
+			for (const SDL_FPoint& point : object.points)
+				pendingSpawnVertices.push_back(b2Vec2(point.x / 32 - (spawn.center.x - (object.x / 32)), -1 * point.y / 32 - (spawn.center.y - (levelHeight - (object.y / 32)))));
+
+			if (movingPlatform) {
+				spawn.movementType = (int)movementType;
+				if (movementType == MPDirections::HORIZONTAL || movementType == MPDirections::DIAGONAL) {
+					spawn.speed.x = object.getFloatProperty("horizontalVelocity");
+					spawn.xMovementBoundaries.x = (float)object.getIntProperty("boundaryLeft") / 32;
+					spawn.xMovementBoundaries.y = (float)object.getIntProperty("boundaryRight") / 32;
+				}
+				if (movementType == MPDirections::VERTICAL || movementType == MPDirections::DIAGONAL) {
+					spawn.speed.y = object.getFloatProperty("verticalVelocity");
+					spawn.yMovementBoundaries.x = levelHeight - (float)object.getIntProperty("boundaryTop") / 32;
+					spawn.yMovementBoundaries.y = levelHeight - (float)object.getIntProperty("boundaryBottom") / 32;
+				}
+				if (movementType == MPDirections::PATH) {
+					spawn.firstWaypoint = (int)pendingSpawnVertices.size();
+					spawn.waypointCount = (int)path->points.size();
+					for (const SDL_FPoint& point : path->points)
+						pendingSpawnVertices.push_back(b2Vec2((path->x + point.x) / 32, levelHeight - (path->y + point.y) / 32));
+					spawn.pathSpeed = object.getFloatProperty("pathSpeed");
+					spawn.pathLoops = object.getBoolProperty("pathLoops");
+					spawn.pathEased = object.getBoolProperty("pathEased");
+				}
+				spawn.usesButton = object.getBoolProperty("usesButton");
+			}
 
-	b2PolygonShape collisionShape;
-	collisionShape.Set(chainPoints, pointCount);
+			pendingEntitySpawns.push_back(spawn);
+			continue;
+		}
 
-	b2FixtureDef fixtureDef;
-	fixtureDef.shape = &collisionShape;
-	fixtureDef.density = 1.0;
-	fixtureDef.friction = 3.0;
-	fixtureDef.userData = movingPlatform ? (void*)MOVING_PLATFORM : (void*)ENTITY;
-	entityBody->CreateFixture(&fixtureDef);
-
-	delete[] chainPoints;
-	chainPoints = NULL;
-
-	if (movingPlatform) {
-		// Need to get the correct direction for the platform
-		b2Vec2 direction(0, 0);
-		b2Vec2 MPVelocity(0, 0);
-		b2Vec2 horizontalMovementBoundaries(0, 0);
-		b2Vec2 verticalMovementBoundaries(0, 0);
-		if (movementType == MPDirections::HORIZONTAL || movementType == MPDirections::DIAGONAL) {
-			direction.x = 1;
-			MPVelocity.x = objectProperties["horizontalVelocity"].getFloatValue();
-			horizontalMovementBoundaries.x = (float)objectProperties["boundaryLeft"].getIntValue() / 32;
-			horizontalMovementBoundaries.y = (float)objectProperties["boundaryRight"].getIntValue() / 32;
+		// Box2D can't make a loop out of less than 3 points
+		if (vertexCount < 3) continue;
+
+		HitboxSpawn spawn = { HitboxKind::SOLID_HITBOX, (int)pendingFixtureTags.size(), firstVertex, vertexCount };
+		FixtureTag tag = { FixtureKind::GROUND, -1, (int)pendingHitboxSpawns.size() };
+		if (object.type == "ladder") {
+			spawn.kind = HitboxKind::LADDER_HITBOX;
+			tag.kind = FixtureKind::LADDER;
+		}
+		else if (object.type == "button") {
+			// The button starts the platform with this ID. A button without one doesn't do anything
+			spawn.kind = HitboxKind::BUTTON_HITBOX;
+			tag.kind = FixtureKind::BUTTON;
+			if (object.hasProperty("platformID"))
+				tag.linkedID = object.getIntProperty("platformID");
 		}
-		if (movementType == MPDirections::VERTICAL || movementType == MPDirections::DIAGONAL) {
-			direction.y = 1;
-			MPVelocity.y = objectProperties["verticalVelocity"].getFloatValue();
-			verticalMovementBoundaries.x = height - (float)objectProperties["boundaryTop"].getIntValue() / 32;
-			verticalMovementBoundaries.y = height - (float)objectProperties["boundaryBottom"].getIntValue() / 32;
+		else if (object.type == "danger") {
+			// If the tile is dangerous, then the collision handler needs to know
+			spawn.kind = HitboxKind::DANGER_HITBOX;
+			tag.kind = FixtureKind::DANGEROUS_TILE;
 		}
+		else if (object.type == "finish") {
+			spawn.kind = HitboxKind::FINISH_HITBOX;
+			tag.kind = FixtureKind::FINISH_POINT;
+			tag.linkedID = object.getIntProperty("level");
+		}
+		pendingFixtureTags.push_back(tag);
 
-		bool usesButton = false;
-		if(objectProperties.count("usesButton") > 0)
-			usesButton = objectProperties["usesButton"].getBoolValue();
+		for (const SDL_FPoint& point : object.points)
+			pendingSpawnVertices.push_back(b2Vec2((object.x + point.x) / 32, levelHeight - (object.y + point.y) / 32));
 
-		MovingPlatform movingPlatform = { tset_gid, spriteRect, entityBody, (int)movementType, usesButton, !usesButton, horizontalMovementBoundaries, verticalMovementBoundaries, MPVelocity, direction };
+		pendingHitboxSpawns.push_back(spawn);
+	}
 
-		// Only start the platform if it doesn't use a button
-		if (usesButton == false)
-			entityBody->SetLinearVelocity(b2Vec2(MPVelocity.x, MPVelocity.y));
+	// Buttons are linked to the ID of their platform in Tiled, which could be any number. The collision listener counts the contacts on each button
+	// in an array with one counter per moving platform, so the buttons are given the index of their platform instead. Platforms are made in
+	// the same order as their spawn records, so this is the platform's index in movingPlatforms too
+	unordered_map<int, int> platformIndices;
+	for (const EntitySpawn& spawn : pendingEntitySpawns) {
+		if (spawn.movingPlatform) {
+			int platformIndex = (int)platformIndices.size();
+			platformIndices[(int)spawn.uid] = platformIndex;
+		}
+	}
+	for (FixtureTag& tag : pendingFixtureTags) {
+		if (tag.kind != FixtureKind::BUTTON || tag.linkedID < 0) continue;
 
-		movingPlatforms.insert(make_pair((int)entityObject->getUID(), movingPlatform));
+		auto platformIndex = platformIndices.find(tag.linkedID);
+		if (platformIndex == platformIndices.end()) {
+			cout << "A button is linked to the platform " << tag.linkedID << ", which doesn't exist" << endl;
+			tag.linkedID = -1;
+		}
+		else
+			tag.linkedID = platformIndex->second;
+	}
+}
+
+void GameLevel::createEntity(const EntitySpawn& spawn) {
+	// Spawns without a valid tile were taken out by finishLoading()
+	DynamicBodyTemplate bodyTemplate;
+	b2BodyDef& entityBodyDef = bodyTemplate.bodyDef;
+	if (spawn.movingPlatform)
+		entityBodyDef.type = b2_kinematicBody;
+	else
+		entityBodyDef.type = b2_dynamicBody;
+	entityBodyDef.position = spawn.center;
+
+	bodyTemplate.shape.Set(&spawnVertices[spawn.firstVertex], spawn.vertexCount);
+
+	bodyTemplate.fixtureDef.density = 1.0;
+	bodyTemplate.fixtureDef.friction = 3.0;
+	bodyTemplate.fixtureDef.userData = &fixtureTags[spawn.fixtureTag];
+	bodyTemplate.fixtureDef.filter = getFixtureFilter(fixtureTags[spawn.fixtureTag].kind);
+
+	if (spawn.movingPlatform) {
+		// Only start the platform if it doesn't use a button. Platforms start off going right and up, and the speed is 0 on the axes they don't move along.
+		// Path platforms start at the first waypoint, and doMovingPlatformLogic gives them their velocity
+		if (spawn.movementType == (int)MPDirections::PATH)
+			entityBodyDef.position = spawnVertices[spawn.firstWaypoint];
+		else if (spawn.usesButton == false)
+			entityBodyDef.linearVelocity = spawn.speed;
+
+		// The body is made later, when the level starts or is reset
+		movingPlatforms.add(spawn, spawnVertices);
+		movingPlatformTemplates.push_back(bodyTemplate);
 	}
 	else {
-		Entity entity = { tset_gid, spriteRect, entityBody };
-		entities.push_back(entity);
+		Entity entity = { spawn.spriteIndex, NULL, entityBodyDef.position, entityBodyDef.angle };
+		initialEntities.push_back(entity);
+		entityTemplates.push_back(bodyTemplate);
 	}
 }
 
-void GameLevel::doMovingPlatformLogic(unordered_map<int, int> buttons) {
-	for (auto buttonMapElement : buttons) {
-		MovingPlatform& platform = movingPlatforms[buttonMapElement.first];
+void MovingPlatforms::clear() {
+	ids.clear();
+	indexByID.clear();
+	spriteIndices.clear();
+	bodies.clear();
+	movesX.clear();
+	movesY.clear();
+	usesButton.clear();
+	active.clear();
+	leftBoundaries.clear();
+	rightBoundaries.clear();
+	topBoundaries.clear();
+	bottomBoundaries.clear();
+	speedX.clear();
+	speedY.clear();
+	directionX.clear();
+	directionY.clear();
+	pathIndices.clear();
+	paths.clear();
+	pathWaypoints.clear();
+	pathDistances.clear();
+	previousX.clear();
+	previousY.clear();
+	turned.clear();
+}
 
-		// To prevent accidental buttons, we can use a simple check
-		if (platform.usesButton == false) continue;
+void MovingPlatforms::add(const EntitySpawn& spawn, const vector<b2Vec2>& spawnVertices) {
+	bool horizontal = spawn.movementType == (int)GameLevel::MPDirections::HORIZONTAL || spawn.movementType == (int)GameLevel::MPDirections::DIAGONAL;
+	bool vertical = spawn.movementType == (int)GameLevel::MPDirections::VERTICAL || spawn.movementType == (int)GameLevel::MPDirections::DIAGONAL;
+
+	indexByID[(int)spawn.uid] = size();
+	ids.push_back((int)spawn.uid);
+	spriteIndices.push_back(spawn.spriteIndex);
+	bodies.push_back(NULL);
+	movesX.push_back(horizontal ? 1.0f : 0.0f);
+	movesY.push_back(vertical ? 1.0f : 0.0f);
+	usesButton.push_back(spawn.usesButton);
+	active.push_back(0);
+	leftBoundaries.push_back(spawn.xMovementBoundaries.x);
+	rightBoundaries.push_back(spawn.xMovementBoundaries.y);
+	topBoundaries.push_back(spawn.yMovementBoundaries.x);
+	bottomBoundaries.push_back(spawn.yMovementBoundaries.y);
+	speedX.push_back(spawn.speed.x);
+	speedY.push_back(spawn.speed.y);
+	directionX.push_back(0);
+	directionY.push_back(0);
+	turned.push_back(0);
+
+	if (spawn.movementType != (int)GameLevel::MPDirections::PATH) {
+		pathIndices.push_back(-1);
+		previousX.push_back(spawn.center.x);
+		previousY.push_back(spawn.center.y);
+		return;
+	}
 
-		if (buttonMapElement.second < 1) {
-			platform.entityBody->SetLinearVelocity(b2Vec2(0, 0));
-			platform.active = false;
-		}
-		else {
-			//cout << "Yooooo stepped on button " << buttonMapElement.first << endl;
-			// The direction will either be -1 or 1, so multiplying it with the speed gets the platform going in the same direction as before
-			platform.entityBody->SetLinearVelocity(b2Vec2(platform.direction.x * platform.speed.x, platform.direction.y * platform.speed.y));
-			platform.active = true;
-		}
+	PlatformPath path = {};
+	path.platformIndex = size() - 1;
+	path.firstWaypoint = (int)pathWaypoints.size();
+	path.speed = spawn.pathSpeed;
+	path.loops = spawn.pathLoops;
+	path.eased = spawn.pathEased;
+
+	for (int i = 0; i < spawn.waypointCount; i++)
+		pathWaypoints.push_back(spawnVertices[spawn.firstWaypoint + i]);
+	if (path.loops)
+		pathWaypoints.push_back(spawnVertices[spawn.firstWaypoint]);
+	path.waypointCount = (int)pathWaypoints.size() - path.firstWaypoint;
+
+	// The distances are added up once here so finding where the platform is only needs a binary search
+	pathDistances.push_back(0);
+	for (int i = path.firstWaypoint + 1; i < path.firstWaypoint + path.waypointCount; i++) {
+		path.length += (pathWaypoints[i] - pathWaypoints[i - 1]).Length();
+		pathDistances.push_back(path.length);
 	}
 
-	for (auto& pair : movingPlatforms) {
-		MovingPlatform& platform = pair.second;
+	pathIndices.push_back((int)paths.size());
+	paths.push_back(path);
+	previousX.push_back(pathWaypoints[path.firstWaypoint].x);
+	previousY.push_back(pathWaypoints[path.firstWaypoint].y);
+}
 
-		// If this platform isn't active, we should skip it. This is because you could get a rare case where the user steps off the button at exactly the right
-		// time to make the platform stop at its boundary. Then boundary checking code would then restart the platform, even if the user is off of the button.
-		if (platform.active == false) {
-			//cout << "Platform not active\n";
-			continue;
-		}
+void MovingPlatforms::reset() {
+	for (int i = 0; i < size(); i++) {
+		// Platforms start off going right and up. The ones with buttons wait for something to press their button
+		directionX[i] = movesX[i];
+		directionY[i] = movesY[i];
+		active[i] = usesButton[i] ? 0.0f : 1.0f;
+		turned[i] = 0;
+	}
 
-		b2Vec2 entityPos = platform.entityBody->GetPosition();
-		b2Vec2 entityVel = platform.entityBody->GetLinearVelocity();
+	for (PlatformPath& path : paths) {
+		path.ticks = 0;
+		path.velocitySegment = -1;
+	}
+}
 
-		// Position of platform is in the center so we need to subtract or add half a meter which is 16px //
-		// A diagonal direction means we need to check both horizontal and vertial components
+b2Vec2 MovingPlatforms::getPathPosition(const PlatformPath& path, double time, int* segment) const {
+	const b2Vec2* waypoints = &pathWaypoints[path.firstWaypoint];
+	const float* distances = &pathDistances[path.firstWaypoint];
+	int segmentCount = path.waypointCount - 1;
 
-		if (platform.movementType == (int)MPDirections::HORIZONTAL || platform.movementType == (int)MPDirections::DIAGONAL) {
-			// Need to start moving right
-			if (entityPos.x - 0.5 <= platform.xMovementBoundaries.x) {
-				entityVel.x = platform.speed.x;
-				platform.direction.x = 1;
-			}
+	// A path with all of its points in the same place (or a platform with no speed) just stays at the start
+	if (path.length <= 0 || path.speed <= 0) {
+		*segment = 0;
+		return waypoints[0];
+	}
 
-			// Need to start moving left
-			else if (entityPos.x + 0.5 >= platform.xMovementBoundaries.y) {
-				entityVel.x = -1 * platform.speed.x;
-				platform.direction.x = -1;
-			}
-		}
+	// Looping paths start again once they get to the end. Other paths come back the way they went, so going there and back is twice as long
+	double distance = fmod(time * path.speed, path.loops ? (double)path.length : 2.0 * path.length);
+	bool returning = distance > path.length;
+	if (returning)
+		distance = 2.0 * path.length - distance;
+
+	// The segment is the last one that starts before this distance
+	int i = (int)(upper_bound(distances + 1, distances + segmentCount, (float)distance) - (distances + 1));
+	float segmentLength = distances[i + 1] - distances[i];
+	float along = segmentLength > 0 ? min(max((float)(distance - distances[i]) / segmentLength, 0.0f), 1.0f) : 0.0f;
+	if (path.eased)
+		along = along * along * (3 - 2 * along);
+
+	*segment = returning ? segmentCount + i : i;
+	return waypoints[i] + along * (waypoints[i + 1] - waypoints[i]);
+}
 
-		if (platform.movementType == (int)MPDirections::VERTICAL || platform.movementType == (int)MPDirections::DIAGONAL) {
-			// Need to start moving down
-			if (entityPos.y + 0.5 >= platform.yMovementBoundaries.x) {
-				entityVel.y = -1 * platform.speed.y;
-				platform.direction.y = -1;
-			}
+// Turns around the platforms that have reached their boundaries, and marks the ones that turned. This goes straight down the arrays without any
+// branches or calls into Box2D, so the compiler can do several platforms at once. The outputs are __restrict so the compiler knows writing them
+// doesn't change the inputs, otherwise it won't vectorize the loop. Position of platform is in the center so we need to subtract or add half a meter
+static void turnPlatformsAtBoundaries(int platformCount, const float* x, const float* y, const float* left, const float* right, const float* top, const float* bottom,
+	const float* movesX, const float* movesY, const float* active, float* __restrict directionX, float* __restrict directionY, Uint8* __restrict turned) {
+
+	for (int i = 0; i < platformCount; i++) {
+		// Need to start moving left, unless it also needs to start moving right
+		float newDirectionX = x[i] + 0.5f >= right[i] ? -1.0f : directionX[i];
+		newDirectionX = x[i] - 0.5f <= left[i] ? 1.0f : newDirectionX;
+		// Need to start moving up, unless it also needs to start moving down
+		float newDirectionY = y[i] - 0.5f <= bottom[i] ? 1.0f : directionY[i];
+		newDirectionY = y[i] + 0.5f >= top[i] ? -1.0f : newDirectionY;
+
+		// Platforms only turn around on the axes they move along. Platforms that aren't active are skipped, because you could get a rare case where the
+		// user steps off the button at exactly the right time to make the platform stop at its boundary. The boundary check would then restart the platform
+		newDirectionX = movesX[i] * active[i] > 0 ? newDirectionX : directionX[i];
+		newDirectionY = movesY[i] * active[i] > 0 ? newDirectionY : directionY[i];
+
+		// | instead of || so there isn't a branch
+		turned[i] = (newDirectionX != directionX[i]) | (newDirectionY != directionY[i]);
+		directionX[i] = newDirectionX;
+		directionY[i] = newDirectionY;
+	}
+}
 
-			// Need to start moving up
-			else if (entityPos.y - 0.5 <= platform.yMovementBoundaries.y) {
-				entityVel.y = platform.speed.y;
-				platform.direction.y = 1;
-			}
+void GameLevel::doMovingPlatformLogic(const vector<int>& buttons, float timestep) {
+	MovingPlatforms& platforms = movingPlatforms;
+	int platformCount = platforms.size();
+
+	// Buttons start and stop their platforms. The velocity only needs setting when a platform starts or stops, not every step that the button is held
+	for (int i = 0; i < platformCount; i++) {
+		// To prevent accidental buttons, we can use a simple check
+		if (!platforms.usesButton[i]) continue;
+
+		float pressed = buttons[i] > 0 ? 1.0f : 0.0f;
+		if (pressed == platforms.active[i]) continue;
+
+		platforms.active[i] = pressed;
+		// Path platforms pick up where they left off on their path, which is done below
+		if (platforms.pathIndices[i] >= 0) {
+			platforms.paths[platforms.pathIndices[i]].velocitySegment = -1;
+			if (pressed) continue;
 		}
 
-		// Update the velocity
-		platform.entityBody->SetLinearVelocity(entityVel);
+		// The direction will either be -1 or 1, so multiplying it with the speed gets the platform going in the same direction as before
+		if (pressed)
+			platforms.bodies[i]->SetLinearVelocity(b2Vec2(platforms.directionX[i] * platforms.speedX[i], platforms.directionY[i] * platforms.speedY[i]));
+		else
+			platforms.bodies[i]->SetLinearVelocity(b2Vec2(0, 0));
+	}
+
+	// savePreviousTransforms() has just stored where the platforms are, so the positions come from there instead of from the bodies
+	turnPlatformsAtBoundaries(platformCount, platforms.previousX.data(), platforms.previousY.data(), platforms.leftBoundaries.data(), platforms.rightBoundaries.data(),
+		platforms.topBoundaries.data(), platforms.bottomBoundaries.data(), platforms.movesX.data(), platforms.movesY.data(), platforms.active.data(),
+		platforms.directionX.data(), platforms.directionY.data(), platforms.turned.data());
+
+	// Platforms keep their velocity until they turn around, so only the ones that turned need to be told about it
+	for (int i = 0; i < platformCount; i++) {
+		if (platforms.turned[i])
+			platforms.bodies[i]->SetLinearVelocity(b2Vec2(platforms.directionX[i] * platforms.speedX[i], platforms.directionY[i] * platforms.speedY[i]));
+	}
+
+	// Path platforms work out where they should be after this step from how long they have been moving, so nothing needs checking against boundaries.
+	// The clock of a platform with a button stops while nothing is on the button
+	for (PlatformPath& path : platforms.paths) {
+		int i = path.platformIndex;
+		if (platforms.active[i] == 0) continue;
+
+		int segment;
+		int nextSegment;
+		b2Vec2 position = platforms.getPathPosition(path, path.ticks * (double)timestep, &segment);
+		b2Vec2 nextPosition = platforms.getPathPosition(path, (path.ticks + 1) * (double)timestep, &nextSegment);
+		path.ticks++;
+
+		// Eased platforms change speed every step, and a step that goes past a waypoint changes direction part way through, so both of those need a new
+		// velocity every step. It is aimed from where the body actually is, which takes out any rounding error from the physics steps before
+		if (path.eased || segment != nextSegment) {
+			b2Vec2 bodyPosition(platforms.previousX[i], platforms.previousY[i]);
+			platforms.bodies[i]->SetLinearVelocity((1.0f / timestep) * (nextPosition - bodyPosition));
+			path.velocitySegment = -1;
+		}
+		// Otherwise the platform goes in a straight line at the same speed until the end of the segment, so the velocity only needs setting once
+		else if (segment != path.velocitySegment) {
+			platforms.bodies[i]->SetLinearVelocity((1.0f / timestep) * (nextPosition - position));
+			path.velocitySegment = segment;
+		}
 	}
 }
 
-void GameLevel::dumpMovingPlatformData(bool param, MovingPlatform* mp) {
-	MovingPlatform p;
-	if (param == true)
-		p = *mp;
-	else
-		p = movingPlatforms[34];
-
-	cout << "Active: " << p.active << endl;
-	cout << "Direction: (" << p.direction.x << ", " << p.direction.y << ")\n";
-	cout << "Movement type: " << p.movementType << endl;
-	cout << "Speed: (" << p.speed.x << ", " << p.speed.y << ")\n";
-	cout << "Sprite rect x: " << p.spriteRect.x << endl;
-	cout << "Sprite rect y: " << p.spriteRect.y << endl;
-	cout << "Tileset GID: " << p.tilesetGID << endl;
-	cout << "Uses button: " << p.usesButton << endl;
-	cout << "Horizontal movement boundaries: (" << p.xMovementBoundaries.x << ", " << p.xMovementBoundaries.y << ")\n";
-	cout << "Vertical movement boundaries: (" << p.yMovementBoundaries.x << ", " << p.yMovementBoundaries.y << ")\n";
+void GameLevel::dumpMovingPlatformData(int platformID) {
+	auto platformIndex = movingPlatforms.indexByID.find(platformID);
+	if (platformIndex == movingPlatforms.indexByID.end()) {
+		cout << "There isn't a moving platform with the ID " << platformID << endl;
+		return;
+	}
+	int i = platformIndex->second;
+	Uint32 spriteIndex = movingPlatforms.spriteIndices[i];
+
+	cout << "Active: " << movingPlatforms.active[i] << endl;
+	cout << "Direction: (" << movingPlatforms.directionX[i] << ", " << movingPlatforms.directionY[i] << ")\n";
+	cout << "Moves along: (" << movingPlatforms.movesX[i] << ", " << movingPlatforms.movesY[i] << ")\n";
+	cout << "Speed: (" << movingPlatforms.speedX[i] << ", " << movingPlatforms.speedY[i] << ")\n";
+	cout << "Sprite rect x: " << tileSprites[spriteIndex].spriteRect.x << endl;
+	cout << "Sprite rect y: " << tileSprites[spriteIndex].spriteRect.y << endl;
+	cout << "Tile GID: " << spriteIndex << endl;
+	cout << "Uses button: " << (bool)movingPlatforms.usesButton[i] << endl;
+	cout << "Horizontal movement boundaries: (" << movingPlatforms.leftBoundaries[i] << ", " << movingPlatforms.rightBoundaries[i] << ")\n";
+	cout << "Vertical movement boundaries: (" << movingPlatforms.topBoundaries[i] << ", " << movingPlatforms.bottomBoundaries[i] << ")\n";
 }
\ No newline at end of file
@@ -4,75 +4,212 @@
 #include <SDL_image.h>
 #include <box2d.h>
 
-#include <tmxlite/Map.hpp>
-#include <tmxlite/TileLayer.hpp>
+#include "SpriteBatch.h"
+#include "TextureAtlas.h"
+#include "Profiler.h"
+#include "LevelFormat.h"
+#include "CollisionGeometry.h"
+#include "Box2dOverrides.h"
 
 #include <string>
 #include <iostream>
 #include <unordered_map>
 
-#define DANGEROUS_TILE 3
-#define LADDER 4
-#define FINISH_POINT 5
-#define MOVING_PLATFORM 6
-#define BUTTON 7
-#define ENTITY 8
+// The static tile layers are baked into chunk textures when the level loads. Each chunk covers this many tiles in both directions
+#define CHUNK_SIZE 16
+static_assert(CHUNK_SIZE == TILE_HITBOX_CELL_SIZE, "Tile hitboxes have to line up with the chunks so streamed levels can merge them");
+// The size in pixels of a tile in the tileset images. The chunk textures are baked at this resolution and scaled when rendering
+#define TILE_SOURCE_SIZE 32
+
+// Levels with more chunks than this are streamed, which means only the chunks near the camera have a baked texture and hitboxes in the physics world.
+// This keeps the texture memory and the size of the physics world the same no matter how long the level is
+#define STREAMING_MIN_CHUNKS 256
+// Chunks this many chunks (or fewer) away from the screen are streamed in
+#define STREAMING_LOAD_RADIUS 1
+// Chunks are only evicted once they are further away than this. It's bigger than the load radius so that a chunk on the edge isn't loaded and evicted
+// over and over when the camera moves back and forth
+#define STREAMING_UNLOAD_RADIUS 2
+// Baking is the slowest part of streaming in a chunk, so only this many are baked each frame. Chunks that aren't baked yet are drawn tile by tile
+#define STREAMING_BAKES_PER_FRAME 2
 
 using namespace std;
 
-// This is a datatype for a tile.
-struct Tile {
-	// We need to know the GID of the tileset this tile belongs to
-	int tilesetGID;
+// Everything needed to draw a tile. The level has one of these for every GID in its tilesets, so a GID can be turned into a texture and source rect
+// with a single array lookup instead of searching through the tilesets
+struct TileSprite {
+	// The atlas page that the tile is in. This is NULL if the GID doesn't belong to a tileset we could load
+	SDL_Texture* texture;
+	// This is the rect used for extracting the tile out of the atlas page
+	SDL_Rect spriteRect;
+};
+
+// All of the tiles of one layer of the map. The tiles are stored row by row, so the tile at x, y (in tiles, not pixels) is at index y * width + x.
+// This means we can go straight to the tiles that are on the screen instead of looking through all of them. Each cell holds the GID of the tile,
+// which is also its index in the level's tile sprite table. A GID of 0 means there isn't a tile in that cell
+struct TileLayer {
+	vector<Uint32> cells;
+};
 
-	// These hold the tile position. The position isnt really where the tile is, but its the number of the tile.
-	// For example x=0, y=0 would be the first tile in the map.
+// A chunk is a square of CHUNK_SIZE x CHUNK_SIZE tiles that has been pre-rendered into a single texture. This means we only need one draw call
+// for the whole chunk instead of one for every tile in it
+struct TileChunk {
+	// The position of the chunk in chunks, not tiles. x=1, y=0 would be the chunk right of the first one
 	int x;
 	int y;
 
-	// This is the rect used for extracting the tile out of the image
-	SDL_Rect spriteRect;
+	// This will be NULL if the chunk doesn't have any tiles in it, so we can skip it when rendering
+	SDL_Texture* texture;
+	// False if the chunk hasn't been baked, in which case it has to be drawn tile by tile
+	bool baked;
+	// Only used by streamed levels. True if the chunk is near the camera, so its hitboxes are in the physics world and it can be baked
+	bool active;
 };
 
 // An entity is something that the player can interact with, like a box or a ball.
 // An entity has a b2Body in the physics world, and it has a tile that is rendered
 struct Entity {
-	// We need to know the GID of the tileset this tile belongs to
-	int tilesetGID;
-	// This is the rect used for extracting the tile out of the image
-	SDL_Rect spriteRect;
+	// The GID of the tile that is drawn for the entity. This is its index in the level's tile sprite table
+	Uint32 spriteIndex;
 
 	// We need this for getting the position and angle of the entity when rendering
 	b2Body* entityBody;
+
+	// Where the entity was before the last simulation step. The entity is drawn somewhere between this and where it is now
+	b2Vec2 previousPosition;
+	float previousAngle;
 };
 
-// Similar to an entity but also has movement boundaries
-struct MovingPlatform {
-	// We need to know the GID of the tileset this tile belongs to
-	int tilesetGID;
-	// This is the rect used for extracting the tile out of the image
-	SDL_Rect spriteRect;
 
-	// We need this for getting the position and angle of the entity when rendering
-	b2Body* entityBody;
-	// 1 for horizontal, 2 for vertical and 3 for diagonal
-	int movementType;
+// The level objects are turned into these spawn records when the level loads, so making the hitboxes doesn't need to compare type strings, look up
+// properties or allocate anything. The points of every record are stored together in one vertex arena, already scaled to meters with y going up
+enum class HitboxKind : Uint8 {
+	SOLID_HITBOX,
+	DANGER_HITBOX,
+	LADDER_HITBOX,
+	BUTTON_HITBOX,
+	FINISH_HITBOX
+};
 
-	bool usesButton;
-	// Used by the boundary checker to decide if it should check the platform
-	bool active;
+// A static hitbox. The points are in world coordinates, so they can be used as they are on a body at the origin
+struct HitboxSpawn {
+	HitboxKind kind;
+	// The index of the hitbox's fixture tag in the level's tag pool
+	int fixtureTag;
+	int firstVertex;
+	int vertexCount;
+};
+
+// An entity or moving platform. The points are relative to the center, which is where the body goes
+struct EntitySpawn {
+	Uint32 uid;
+	bool movingPlatform;
+	int fixtureTag;
+	Uint32 spriteIndex;
+	b2Vec2 center;
+	int firstVertex;
+	int vertexCount;
 
-	// Need this to check if the platform should reverse direction. The first vector are the leftand right boundaries respectively.
-	// Same thing for the second vector, but it's top and bottom (respectively).
+	// Only used by moving platforms. These are the same as in MovingPlatforms
+	int movementType;
+	bool usesButton;
 	b2Vec2 xMovementBoundaries;
 	b2Vec2 yMovementBoundaries;
+	b2Vec2 speed;
+
+	// Only used by path platforms. The waypoints are in the vertex arena after the points of the shape, and are where the center of the platform goes
+	int firstWaypoint;
+	int waypointCount;
+	float pathSpeed;
+	bool pathLoops;
+	bool pathEased;
+};
+
+// A moving platform that follows a line of waypoints instead of bouncing between its boundaries. Where the platform is gets worked out from how long
+// it has been moving, so it can't drift away from its path and ends up in exactly the same place no matter how the frames were timed
+struct PlatformPath {
+	int platformIndex;
+	// Where the path's waypoints start in the level's path waypoints and distances. Looping paths have their first waypoint again at the end
+	int firstWaypoint;
+	int waypointCount;
+	// How far it is along all of the waypoints, including the way back to the start if the path loops
+	float length;
+	float speed;
+	// Looping paths go from the last waypoint back to the first one. Other paths turn around at the ends and come back the way they went
+	bool loops;
+	// Eased platforms slow down to a stop at every waypoint and speed up again after it, instead of moving at the same speed the whole way
+	bool eased;
+
+	// How many steps the platform has been moving for
+	Uint32 ticks;
+	// The segment whose velocity the body has, so it only gets set again when the platform moves onto another segment. -1 if it needs setting
+	int velocitySegment;
+};
+
+// The moving platforms of a level. Each field has its own array and a platform has the same index in all of them, so the boundary checks can go
+// straight down arrays of floats instead of hopping between structs and hash map nodes. Levels can have thousands of platforms and they are all checked every step
+struct MovingPlatforms {
+	// The ID of each platform, which is what its button links to. indexByID turns an ID back into an index
+	vector<int> ids;
+	unordered_map<int, int> indexByID;
+	// The GID of the tile that is drawn for the platform. This is its index in the level's tile sprite table
+	vector<Uint32> spriteIndices;
+	// We need these for getting the positions when rendering and for setting the velocities
+	vector<b2Body*> bodies;
+
+	// 1 if the platform moves along that axis and 0 if it doesn't. Diagonal platforms move along both
+	vector<float> movesX;
+	vector<float> movesY;
+	vector<Uint8> usesButton;
+	// 1 if the platform is moving. Platforms with buttons are stopped while nothing is on their button, and the boundary checks skip them
+	vector<float> active;
+
+	// The boundaries the platform turns around at. Top is the bigger y because y goes up
+	vector<float> leftBoundaries;
+	vector<float> rightBoundaries;
+	vector<float> topBoundaries;
+	vector<float> bottomBoundaries;
 
 	// The horizontal and vertical speed need to be separate because of diagonal movement. If they are the smae, the platform may reach its vertical
 	// destination at a different time to the horizotnal destination which makes it move in a wierd pattern
-	b2Vec2 speed;
-	// The direction will just hold the current direction of the platform. 1 if it is moving right/up and -1 if it is moving left/down.
-	// The horizontal and vertical directions are separate.
-	b2Vec2 direction;
+	vector<float> speedX;
+	vector<float> speedY;
+	// 1 if the platform is moving right/up and -1 if it is moving left/down. The horizontal and vertical directions are separate, and are 0 on
+	// an axis the platform doesn't move along
+	vector<float> directionX;
+	vector<float> directionY;
+
+	// Which path each platform follows, or -1 if it bounces between its boundaries. Path platforms don't move along either axis as far as the
+	// boundary checks are concerned
+	vector<int> pathIndices;
+	vector<PlatformPath> paths;
+	// The waypoints of every path, and how far along its path each waypoint is
+	vector<b2Vec2> pathWaypoints;
+	vector<float> pathDistances;
+
+	// Where the platform was before the last simulation step
+	vector<float> previousX;
+	vector<float> previousY;
+	// Set by the boundary checks for the platforms that turned around, so only their velocities are written back to the bodies
+	vector<Uint8> turned;
+
+	int size() const { return (int)ids.size(); }
+	void clear();
+	// Adds a platform without a body. The direction and active flag are set by reset(). The spawn vertices are needed for the waypoints of path platforms
+	void add(const EntitySpawn& spawn, const vector<b2Vec2>& spawnVertices);
+	// Puts every platform back to how it started. The bodies have to be remade separately
+	void reset();
+	// Where a path platform should be once it has been moving for this long (in seconds), and which segment of the path it is on. Going back along
+	// a segment counts as a different segment to going forwards along it, because the velocity is the other way
+	b2Vec2 getPathPosition(const PlatformPath& path, double time, int* segment) const;
+};
+
+// Everything needed to make the body of an entity or moving platform again. These are captured when the level is started, so respawning only has to
+// remake the bodies that move instead of going through the level objects and rebuilding the whole physics world
+struct DynamicBodyTemplate {
+	b2BodyDef bodyDef;
+	b2PolygonShape shape;
+	// The shape isn't set in here, because it would point at the wrong template once the template is copied into a vector
+	b2FixtureDef fixtureDef;
 };
 
 class GameLevel {
@@ -80,29 +217,103 @@ public:
 	GameLevel();
 	void destroy();
 
-	bool load(int screenWidth, int screenHeight, int tileSize, SDL_Renderer* ren, const char* filename, string mapDirectory, b2World* world);
-	void render(float camXOffset, float camYOffset);
+	// Gives the level everything it needs to load and render. This is done once at startup, and the level can then be loaded and unloaded as many times as needed
+	// Setting forceStreaming streams the level even if it is small enough to be loaded all at once
+	void setup(int screenWidth, int screenHeight, int tileSize, SDL_Renderer* ren, SpriteBatch* batch, TextureAtlas* atlas, bool forceStreaming);
+
+	// Loading is split into two halves so the slow half can be done on a loading thread while the game keeps running. prepare() reads the level file
+	// and decodes the tileset images, and doesn't touch the renderer, the atlas or anything the render loop uses, so it can run on any thread.
+	// finishLoading() packs the tilesets and bakes the chunks, and has to run on the main thread after prepare() has returned true.
+	// The filename doesn't have an extension. The compiled level (.lvl) is loaded if there is one, otherwise the Tiled map (.tmx) is loaded. Setting
+	// loadTMX always loads the Tiled map
+	bool prepare(string mapFilename, string mapDirectory, bool loadTMX);
+	bool finishLoading();
+	// Does both halves of loading straight away on this thread
+	bool load(string mapFilename, string mapDirectory, bool loadTMX);
+	// Frees everything the level loaded, including the chunk textures. The level can be loaded again afterwards
+	void unload();
+	bool isLoaded() { return loaded; }
+
+	// The interpolation is how far we are between the previous simulation step and the current one (0 to 1). Things that move are drawn between the two
+	void render(float camXOffset, float camYOffset, float interpolation);
+	// Stores the positions of the entities and platforms before a simulation step so that render() can blend between the steps. This is done right
+	// before every step, so doMovingPlatformLogic uses the platform positions stored here instead of asking every body again
+	void savePreviousTransforms();
 	void createHitboxes(b2World* world);
+	// Destroys the entities and moving platforms and makes them again from their templates, so they are back where they were when the level started
+	void resetDynamicBodies();
+	// Renders the static tiles into the chunk textures. This is done when loading, but also needs to be done again if the renderer loses its render targets
+	void bakeChunks();
+	// Streams the chunks in and out around the camera. This needs to be called every frame before the physics steps, and does nothing if the level isn't streamed.
+	// The tile layers and level objects are small compared to the chunk textures and physics bodies, so they stay in memory for the whole level
+	void updateStreaming(float camXOffset, float camYOffset);
 
-	// This will change the direction of the platform if it has reached its boundaries, and stop/start the platform if needed
-	void doMovingPlatformLogic(unordered_map<int, int> buttons);
-	// The direction is needed for setting the platforms velocity and adding that velocity to the player
-	enum class MPDirections {NOT_SET, HORIZONTAL, VERTICAL, DIAGONAL};
+	// This will change the direction of the platform if it has reached its boundaries, and stop/start the platform if needed. buttons holds how many
+	// things are on the button of each platform, and has to have one counter for every platform. The timestep is how
+	// long the physics step after this is, which path platforms need to know so they end up in the right place
+	void doMovingPlatformLogic(const vector<int>& buttons, float timestep);
+	// The direction is needed for setting the platforms velocity and adding that velocity to the player. Path platforms follow a polyline instead
+	enum class MPDirections {NOT_SET, HORIZONTAL, VERTICAL, DIAGONAL, PATH};
 
-	void dumpMovingPlatformData(bool param, MovingPlatform* mp);
+	// Prints everything about a moving platform. Only used for debugging
+	void dumpMovingPlatformData(int platformID);
+	int getMovingPlatformCount() { return movingPlatforms.size(); }
 
 private:
+	// Only set by finishLoading() and unload(), which both run on the main thread
+	bool loaded = false;
+	// What prepare() loaded, waiting for finishLoading() to turn it into the tile layers and textures. The images are in the same order as the tilesets
+	LevelData pendingLevelData;
+	vector<SDL_Surface*> pendingTilesetImages;
+	vector<HitboxSpawn> pendingHitboxSpawns;
+	vector<EntitySpawn> pendingEntitySpawns;
+	vector<b2Vec2> pendingSpawnVertices;
+	vector<FixtureTag> pendingFixtureTags;
+
 	// The map data
 	int width = 0;
 	int height = 0;
 
-	vector<Tile> tiles;
+	// The tile layers in the order they are drawn
+	vector<TileLayer> tileLayers;
+	// The baked static tile layers, stored row by row. There are chunkColumns * chunkRows chunks
+	vector<TileChunk> chunks;
+	int chunkColumns = 0;
+	int chunkRows = 0;
 	vector<Entity> entities;
-	unordered_map<int, MovingPlatform> movingPlatforms;
-	vector<tmx::Object> collisionObjects;
+	MovingPlatforms movingPlatforms;
+	// How the entities were when the level started, without their bodies, and the templates to make the entity and platform bodies from. The entity
+	// templates are in the same order as the entities, and the platform templates are in the same order as the platforms. The platforms put
+	// themselves back to how they started, so they don't need a copy
+	vector<Entity> initialEntities;
+	vector<DynamicBodyTemplate> entityTemplates;
+	vector<DynamicBodyTemplate> movingPlatformTemplates;
+	// The spawn records made from the objects in the level file. The hitboxes, entities and platforms are made from these whenever the level is started
+	vector<HitboxSpawn> hitboxSpawns;
+	vector<EntitySpawn> entitySpawns;
+	// The points of all of the spawn records
+	vector<b2Vec2> spawnVertices;
+	// The user data of every fixture the level makes. The fixtures point into this, so it can't change size while the level is loaded
+	vector<FixtureTag> fixtureTags;
+	// The static body that each hitbox is on. This is the same body for every hitbox unless the level is streamed. Streamed levels destroy these as
+	// their chunks are evicted, so most of them will be NULL
+	vector<b2Body*> staticObjectBodies;
+	// The world the hitboxes are in, so streamed chunks can add and remove them
+	b2World* physicsWorld = NULL;
 
-	// This will be an map of tilesets that this level contains. A tileset element will have a first GID, and then a pair of last GID and sprite sheet texture
-	map<int, pair<int, SDL_Texture*>> tilesets;
+	bool forceStreaming = false;
+	bool streaming = false;
+	// The chunks that each hitbox touches. x and y are the first chunk, and w and h are the last chunk (not the size). Only used when streaming
+	vector<SDL_Rect> objectChunkRanges;
+	// The hitboxes that touch each chunk. Only used when streaming
+	vector<vector<int>> chunkObjects;
+	// The indexes of the chunks that are streamed in
+	vector<int> activeChunks;
+	// Set to false if the renderer can't make chunk textures, so we stop trying
+	bool canBakeChunks = true;
+
+	// The texture and source rect for every GID in this level's tilesets. This is built once when the level loads. Index 0 is the empty tile
+	vector<TileSprite> tileSprites;
 
 	// Dimensions of screen
 	int SCREEN_WIDTH = 0;
@@ -112,11 +323,43 @@ private:
 
 	// We need a pointer to the renderer to render and create textures for this level
 	SDL_Renderer* renderer = NULL;
+	// The entities, platforms and chunks are drawn through the sprite batch
+	SpriteBatch* spriteBatch = NULL;
+	// The tilesets are packed into the atlas. The atlas owns the textures, so the level doesn't destroy them
+	TextureAtlas* textureAtlas = NULL;
+	// The names of the atlas images that this level holds a reference to
+	vector<string> atlasImages;
 
-	void createEntity(tmx::Object* entityObject, b2World* world, bool movingPlatform, unordered_map<string, tmx::Property> objectProperties);
+	// Turns the level objects into spawn records. This is part of prepare(), so it only touches the pending members
+	void createSpawnRecords(const vector<LevelObject>& objects, int levelHeight);
+	// Adds the template for an entity or moving platform. The body isn't made until createDynamicBodies() is called
+	void createEntity(const EntitySpawn& spawn);
+	// Makes the entities and moving platforms from their templates
+	void createDynamicBodies();
+	b2Body* createDynamicBody(const DynamicBodyTemplate& bodyTemplate);
 
-	// Checks if a tile is inside the camera boundaries
+	// Checks if a tile (or any other rect) is inside the camera boundaries
 	bool isTileInRect(SDL_Rect* tileRect);
-	// When rendering from a tilesheet we need coordinates to extract a specific tile. Thats what this function returns
-	bool getTileSourceRect(int tileGID, int* tset_gid, SDL_Rect* outputRect);
+	// Works out the range of columns and rows of a grid that are inside the camera. The grid is lined up with the map and each cell is cellSize pixels.
+	// The last column and row are inclusive, and if nothing is visible then the last column/row will be smaller than the first
+	void getVisibleCells(int cellSize, int columns, int rows, float camXOffset, float camYOffset, int* firstColumn, int* lastColumn, int* firstRow, int* lastRow);
+	void destroyChunkTextures();
+	// Bakes one chunk. The render target is left on the chunk texture so that a few chunks can be baked before going back to the window
+	bool bakeChunk(TileChunk& chunk);
+	void renderChunkTiles(const TileChunk& chunk, float camXOffset, float camYOffset);
+	// Makes a static body for a hitbox, which is what streamed levels use so the hitboxes can be removed one by one
+	b2Body* createStaticHitbox(const HitboxSpawn& spawn, b2World* world);
+	// Adds a hitbox to a static body. The body has to be at the origin, because the points are in world coordinates
+	void addStaticFixture(const HitboxSpawn& spawn, b2Body* body);
+
+	// Whether a level this big (in tiles) is streamed. prepare() needs to know before the chunks are made, so it can merge the hitboxes the right way
+	bool shouldStream(int levelWidth, int levelHeight);
+	void findObjectChunks();
+	void activateChunk(int chunkIndex);
+	void deactivateChunk(int chunkIndex);
+	void createChunkHitboxes(int chunkIndex);
+	// Adds the source rects for all of the tiles in a tileset to the tile sprite table
+	void addTilesetSprites(int firstGID, int lastGID, const AtlasRegion& tilesetRegion);
+	// Returns true if the GID belongs to one of the tilesets that was loaded
+	bool isValidTile(Uint32 tileGID) { return tileGID < tileSprites.size() && tileSprites[tileGID].texture != NULL; }
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+// The level compiler turns Tiled maps into the compiled level format that the game loads (see LevelFormat.h). Run it from the folder that has the
+// resources folder in it, because the tileset image paths are stored the way the game will load them:
+//
+//     LevelCompiler "resources/maps/level 0.tmx" "resources/maps/level 1.tmx" ...
+//
+// Each map is written next to the .tmx file with a .lvl extension. compileLevels.bat does this for all of the levels
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+
+#include <iostream>
+#include <string>
+
+#include "../LevelFormat.h"
+
+using namespace std;
+
+int main(int argc, char* args[]) {
+	if (argc < 2) {
+		cout << "Usage: LevelCompiler <map.tmx> [more maps...]" << endl;
+		return 1;
+	}
+
+	int failedCount = 0;
+	for (int i = 1; i < argc; i++) {
+		string mapFilename = args[i];
+
+		// The tileset paths in the maps are relative to the folder the map is in
+		size_t lastSlash = mapFilename.find_last_of("/\\");
+		string mapDirectory = lastSlash == string::npos ? "" : mapFilename.substr(0, lastSlash + 1);
+
+		size_t extension = mapFilename.rfind(".tmx");
+		string compiledFilename = (extension == string::npos ? mapFilename : mapFilename.substr(0, extension)) + ".lvl";
+
+		LevelData level;
+		if (!loadLevelFromTMX(mapFilename.c_str(), mapDirectory, &level) || !writeCompiledLevel(compiledFilename.c_str(), level)) {
+			cout << "Couldn't compile " << mapFilename << endl;
+			failedCount++;
+			continue;
+		}
+
+		// Load it straight back in to make sure the game will be able to read it
+		LevelData compiledLevel;
+		if (!loadCompiledLevel(compiledFilename.c_str(), &compiledLevel) || compiledLevel.objects.size() != level.objects.size() || compiledLevel.tileLayers != level.tileLayers) {
+			cout << "The compiled level " << compiledFilename << " didn't load back properly" << endl;
+			failedCount++;
+			continue;
+		}
+
+		cout << mapFilename << " -> " << compiledFilename << ": " << level.width << "x" << level.height << " tiles, " << level.tileLayers.size() << " layers, "
+			<< level.tilesets.size() << " tilesets, " << level.objects.size() << " objects" << endl;
+	}
+
+	return failedCount > 0 ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+#include "LevelFormat.h"
+#include "CollisionGeometry.h"
+
+#include <tmxlite/Map.hpp>
+#include <tmxlite/TileLayer.hpp>
+#include <tmxlite/ObjectGroup.hpp>
+
+#include <cstring>
+#include <iostream>
+
+// Reads a whole file into memory with SDL_RWops, which (unlike ifstream) can also read from the assets on an android device
+static bool readFile(const char* filename, vector<Uint8>* contents) {
+	SDL_RWops* file = SDL_RWFromFile(filename, "rb");
+	if (file == NULL) return false;
+
+	Sint64 fileSize = SDL_RWsize(file);
+	if (fileSize < 0) {
+		SDL_RWclose(file);
+		return false;
+	}
+
+	contents->resize((size_t)fileSize);
+	size_t readCount = fileSize > 0 ? SDL_RWread(file, contents->data(), (size_t)fileSize, 1) : 1;
+	SDL_RWclose(file);
+
+	return readCount == 1;
+}
+
+bool loadLevelFromTMX(const char* filename, string mapDirectory, LevelData* level) {
+	// We cant just use map.load because it uses standard ifstream instead of SDL's rwops. Instead, we read the map into a buffer and load it from a string
+	vector<Uint8> mapFileContents;
+	if (!readFile(filename, &mapFileContents)) {
+		cout << "Couldn't open map " << filename << endl;
+		return false;
+	}
+
+	tmx::Map tiledMap;
+	if (tiledMap.loadFromString(string(mapFileContents.begin(), mapFileContents.end()), "") == false) {
+		// Check for unsuccesful map load
+		cout << "Failed to load map " << filename << endl;
+		return false;
+	}
+
+	level->width = tiledMap.getTileCount().x;
+	level->height = tiledMap.getTileCount().y;
+
+	// The GIDs of the tiles that are solid, and the type of hitbox they make
+	unordered_map<Uint32, string> collisionTiles;
+
+	for (auto& tileset : tiledMap.getTilesets()) {
+		// A tile is solid if it has a "solid" property that is true, or if the whole tileset has one. Solid tiles make normal ground unless they
+		// have a "hitboxType" property (like "danger"), which is the same as the type of a hand drawn hitbox. Tiles that aren't drawn can still
+		// be solid, so this is done before the tilesets without an image are skipped
+		bool tilesetSolid = false;
+		string imagePathProperty;
+		for (auto& tilesetProperty : tileset.getProperties()) {
+			if (tilesetProperty.getName() == "solid" && tilesetProperty.getType() == tmx::Property::Type::Boolean)
+				tilesetSolid = tilesetProperty.getBoolValue();
+			else if (tilesetProperty.getName() == "relative_path")
+				imagePathProperty = tilesetProperty.getStringValue();
+		}
+
+		if (tilesetSolid) {
+			for (Uint32 gid = tileset.getFirstGID(); gid <= tileset.getLastGID(); gid++)
+				collisionTiles[gid] = "";
+		}
+
+		for (auto& tile : tileset.getTiles()) {
+			bool solid = tilesetSolid;
+			string hitboxType;
+			for (auto& tileProperty : tile.properties) {
+				if (tileProperty.getName() == "solid" && tileProperty.getType() == tmx::Property::Type::Boolean)
+					solid = tileProperty.getBoolValue();
+				else if (tileProperty.getName() == "hitboxType" && tileProperty.getType() == tmx::Property::Type::String) {
+					solid = true;
+					hitboxType = tileProperty.getStringValue();
+				}
+			}
+
+			Uint32 gid = tileset.getFirstGID() + tile.ID;
+			if (solid)
+				collisionTiles[gid] = hitboxType;
+			else
+				collisionTiles.erase(gid);
+		}
+
+		// Only use this tileset if the tileset is a single image - not supporting collection of images right now. The image path that the game
+		// uses is in the "relative_path" property of the tileset (or the first property in older maps), because the real image path is relative
+		// to wherever the map was made
+		if (tileset.getImagePath() == "" || tileset.getProperties().empty())
+			continue;
+		if (imagePathProperty == "")
+			imagePathProperty = tileset.getProperties()[0].getStringValue();
+
+		LevelTileset levelTileset;
+		levelTileset.firstGID = tileset.getFirstGID();
+		levelTileset.lastGID = tileset.getLastGID();
+		levelTileset.imagePath = mapDirectory + imagePathProperty;
+		level->tilesets.push_back(levelTileset);
+	}
+
+	for (auto& layer : tiledMap.getLayers()) {
+		// The "collisions" object layer holds the hitboxes and entities for the level
+		if (layer->getName() == "collisions" && layer->getType() == tmx::Layer::Type::Object) {
+			for (auto& object : layer->getLayerAs<tmx::ObjectGroup>().getObjects()) {
+				LevelObject levelObject;
+				levelObject.uid = object.getUID();
+				levelObject.type = object.getType();
+				levelObject.x = object.getPosition().x;
+				levelObject.y = object.getPosition().y;
+
+				for (auto& point : object.getPoints())
+					levelObject.points.push_back({ point.x, point.y });
+
+				for (auto& objectProperty : object.getProperties()) {
+					LevelProperty property;
+					switch (objectProperty.getType()) {
+					case tmx::Property::Type::Boolean:
+						property.type = LevelPropertyType::BOOL;
+						property.boolValue = objectProperty.getBoolValue();
+						break;
+					case tmx::Property::Type::Int:
+						property.type = LevelPropertyType::INT;
+						property.intValue = objectProperty.getIntValue();
+						break;
+					case tmx::Property::Type::Float:
+						property.type = LevelPropertyType::FLOAT;
+						property.floatValue = objectProperty.getFloatValue();
+						break;
+					case tmx::Property::Type::String:
+						property.type = LevelPropertyType::STRING;
+						property.stringValue = objectProperty.getStringValue();
+						break;
+					case tmx::Property::Type::File:
+						property.type = LevelPropertyType::STRING;
+						property.stringValue = objectProperty.getFileValue();
+						break;
+					default:
+						// Colours aren't used by anything
+						continue;
+					}
+
+					levelObject.properties.insert(make_pair(objectProperty.getName(), property));
+				}
+
+				level->objects.push_back(levelObject);
+			}
+		}
+
+		if (layer->getType() != tmx::Layer::Type::Tile)
+			continue;
+
+		auto& layerTiles = layer->getLayerAs<tmx::TileLayer>().getTiles();
+		vector<Uint32> cells(level->width * level->height, 0);
+		for (int i = 0; i < cells.size() && i < layerTiles.size(); i++)
+			cells[i] = layerTiles[i].ID;
+
+		level->tileLayers.push_back(cells);
+	}
+
+	// The hitboxes for the solid tiles are made here rather than when the level is loaded into the game, so compiled levels already have them
+	addTileHitboxes(level, collisionTiles, tiledMap.getTileSize().x, tiledMap.getTileSize().y);
+
+	return true;
+}
+
+// Checks that a section of count things of the given size fits inside the file and is lined up properly
+static bool isSectionValid(Uint32 offset, Uint32 count, size_t size, size_t fileSize) {
+	return offset % 4 == 0 && offset <= fileSize && (Uint64)count * size <= fileSize - offset;
+}
+
+bool loadCompiledLevel(const char* filename, LevelData* level) {
+	vector<Uint8> contents;
+	if (!readFile(filename, &contents)) return false;
+
+	if (contents.size() < sizeof(LevelFileHeader)) {
+		SDL_Log("%s is too small to be a compiled level", filename);
+		return false;
+	}
+
+	const LevelFileHeader* header = (const LevelFileHeader*)contents.data();
+	if (header->magic != LEVEL_FILE_MAGIC || header->version != LEVEL_FILE_VERSION || header->fileSize != contents.size()) {
+		SDL_Log("%s isn't a compiled level from this version of the game. Recompile it with LevelCompiler", filename);
+		return false;
+	}
+
+	// Make sure nothing points outside of the file before we go reading it
+	if (!isSectionValid(header->tilesetOffset, header->tilesetCount, sizeof(LevelFileTileset), contents.size()) ||
+		!isSectionValid(header->layerOffset, header->layerCount, (size_t)header->width * header->height * sizeof(Uint32), contents.size()) ||
+		!isSectionValid(header->objectOffset, header->objectCount, sizeof(LevelFileObject), contents.size()) ||
+		!isSectionValid(header->vertexOffset, header->vertexCount, sizeof(LevelFileVertex), contents.size()) ||
+		!isSectionValid(header->propertyOffset, header->propertyCount, sizeof(LevelFileProperty), contents.size()) ||
+		!isSectionValid(header->stringsOffset, header->stringsSize, 1, contents.size()) ||
+		header->stringsSize == 0 || contents[header->stringsOffset + header->stringsSize - 1] != '\0') {
+		SDL_Log("%s is broken", filename);
+		return false;
+	}
+
+	const char* strings = (const char*)&contents[header->stringsOffset];
+	const LevelFileTileset* tilesets = (const LevelFileTileset*)&contents[header->tilesetOffset];
+	const Uint32* layers = (const Uint32*)&contents[header->layerOffset];
+	const LevelFileObject* objects = (const LevelFileObject*)&contents[header->objectOffset];
+	const LevelFileVertex* vertices = (const LevelFileVertex*)&contents[header->vertexOffset];
+	const LevelFileProperty* properties = (const LevelFileProperty*)&contents[header->propertyOffset];
+
+	// Any string offset past the end of the string section is replaced with the empty string at the start of it
+	auto getString = [&](Uint32 offset) { return string(offset < header->stringsSize ? strings + offset : strings); };
+
+	level->width = header->width;
+	level->height = header->height;
+
+	level->tilesets.resize(header->tilesetCount);
+	for (Uint32 i = 0; i < header->tilesetCount; i++) {
+		level->tilesets[i].firstGID = tilesets[i].firstGID;
+		level->tilesets[i].lastGID = tilesets[i].lastGID;
+		level->tilesets[i].imagePath = getString(tilesets[i].imagePath);
+	}
+
+	// The tiles are already in the same layout as the game uses, so each layer is just one copy
+	size_t cellCount = (size_t)header->width * header->height;
+	level->tileLayers.resize(header->layerCount);
+	for (Uint32 i = 0; i < header->layerCount; i++)
+		level->tileLayers[i].assign(layers + i * cellCount, layers + (i + 1) * cellCount);
+
+	level->objects.resize(header->objectCount);
+	for (Uint32 i = 0; i < header->objectCount; i++) {
+		const LevelFileObject& fileObject = objects[i];
+		LevelObject& object = level->objects[i];
+
+		if ((Uint64)fileObject.firstVertex + fileObject.vertexCount > header->vertexCount || (Uint64)fileObject.firstProperty + fileObject.propertyCount > header->propertyCount) {
+			SDL_Log("%s is broken", filename);
+			return false;
+		}
+
+		object.uid = fileObject.uid;
+		object.type = getString(fileObject.type);
+		object.x = fileObject.x;
+		object.y = fileObject.y;
+
+		object.points.resize(fileObject.vertexCount);
+		for (Uint32 v = 0; v < fileObject.vertexCount; v++)
+			object.points[v] = { vertices[fileObject.firstVertex + v].x, vertices[fileObject.firstVertex + v].y };
+
+		for (Uint32 p = 0; p < fileObject.propertyCount; p++) {
+			const LevelFileProperty& fileProperty = properties[fileObject.firstProperty + p];
+
+			LevelProperty property;
+			property.type = fileProperty.type;
+			switch (fileProperty.type) {
+			case LevelPropertyType::BOOL:
+				property.boolValue = fileProperty.intValue != 0;
+				break;
+			case LevelPropertyType::INT:
+				property.intValue = fileProperty.intValue;
+				break;
+			case LevelPropertyType::FLOAT:
+				property.floatValue = fileProperty.floatValue;
+				break;
+			case LevelPropertyType::STRING:
+				property.stringValue = getString(fileProperty.stringValue);
+				break;
+			}
+
+			object.properties.insert(make_pair(getString(fileProperty.name), property));
+		}
+	}
+
+	return true;
+}
+
+// Adds a string to the string section and returns its offset. Strings that are used more than once (like object types) are only stored once
+static Uint32 addString(const string& text, vector<char>* strings, unordered_map<string, Uint32>* stringOffsets) {
+	auto existingString = stringOffsets->find(text);
+	if (existingString != stringOffsets->end())
+		return existingString->second;
+
+	Uint32 offset = (Uint32)strings->size();
+	strings->insert(strings->end(), text.begin(), text.end());
+	strings->push_back('\0');
+	stringOffsets->insert(make_pair(text, offset));
+	return offset;
+}
+
+bool writeCompiledLevel(const char* filename, const LevelData& level) {
+	vector<char> strings;
+	unordered_map<string, Uint32> stringOffsets;
+	// The empty string is always at offset 0
+	addString("", &strings, &stringOffsets);
+
+	vector<LevelFileTileset> tilesets;
+	for (const LevelTileset& tileset : level.tilesets)
+		tilesets.push_back({ tileset.firstGID, tileset.lastGID, addString(tileset.imagePath, &strings, &stringOffsets) });
+
+	vector<LevelFileObject> objects;
+	vector<LevelFileVertex> vertices;
+	vector<LevelFileProperty> properties;
+	for (const LevelObject& object : level.objects) {
+		LevelFileObject fileObject;
+		fileObject.uid = object.uid;
+		fileObject.type = addString(object.type, &strings, &stringOffsets);
+		fileObject.x = object.x;
+		fileObject.y = object.y;
+
+		fileObject.firstVertex = (Uint32)vertices.size();
+		fileObject.vertexCount = (Uint32)object.points.size();
+		for (const SDL_FPoint& point : object.points)
+			vertices.push_back({ point.x, point.y });
+
+		fileObject.firstProperty = (Uint32)properties.size();
+		fileObject.propertyCount = (Uint32)object.properties.size();
+		for (auto& namedProperty : object.properties) {
+			LevelFileProperty fileProperty;
+			fileProperty.name = addString(namedProperty.first, &strings, &stringOffsets);
+			fileProperty.type = namedProperty.second.type;
+			switch (namedProperty.second.type) {
+			case LevelPropertyType::BOOL:
+				fileProperty.intValue = namedProperty.second.boolValue ? 1 : 0;
+				break;
+			case LevelPropertyType::INT:
+				fileProperty.intValue = namedProperty.second.intValue;
+				break;
+			case LevelPropertyType::FLOAT:
+				fileProperty.floatValue = namedProperty.second.floatValue;
+				break;
+			case LevelPropertyType::STRING:
+				fileProperty.stringValue = addString(namedProperty.second.stringValue, &strings, &stringOffsets);
+				break;
+			}
+			properties.push_back(fileProperty);
+		}
+
+		objects.push_back(fileObject);
+	}
+
+	// Pad the strings so the file size stays a multiple of 4
+	while (strings.size() % 4 != 0)
+		strings.push_back('\0');
+
+	size_t cellCount = (size_t)level.width * level.height;
+
+	LevelFileHeader header;
+	header.magic = LEVEL_FILE_MAGIC;
+	header.version = LEVEL_FILE_VERSION;
+	header.width = level.width;
+	header.height = level.height;
+	header.tilesetCount = (Uint32)tilesets.size();
+	header.tilesetOffset = sizeof(LevelFileHeader);
+	header.layerCount = (Uint32)level.tileLayers.size();
+	header.layerOffset = header.tilesetOffset + header.tilesetCount * sizeof(LevelFileTileset);
+	header.objectCount = (Uint32)objects.size();
+	header.objectOffset = (Uint32)(header.layerOffset + header.layerCount * cellCount * sizeof(Uint32));
+	header.vertexCount = (Uint32)vertices.size();
+	header.vertexOffset = header.objectOffset + header.objectCount * sizeof(LevelFileObject);
+	header.propertyCount = (Uint32)properties.size();
+	header.propertyOffset = header.vertexOffset + header.vertexCount * sizeof(LevelFileVertex);
+	header.stringsSize = (Uint32)strings.size();
+	header.stringsOffset = header.propertyOffset + header.propertyCount * sizeof(LevelFileProperty);
+	header.fileSize = header.stringsOffset + header.stringsSize;
+
+	SDL_RWops* file = SDL_RWFromFile(filename, "wb");
+	if (file == NULL) {
+		cout << "Couldn't open " << filename << " for writing. Error: " << SDL_GetError() << endl;
+		return false;
+	}
+
+	SDL_RWwrite(file, &header, sizeof(header), 1);
+	if (!tilesets.empty()) SDL_RWwrite(file, tilesets.data(), sizeof(LevelFileTileset), tilesets.size());
+	for (const vector<Uint32>& layer : level.tileLayers) {
+		// Layers should always be the size of the map, but pad or cut them just in case so the file stays valid
+		vector<Uint32> cells(layer);
+		cells.resize(cellCount, 0);
+		if (cellCount > 0) SDL_RWwrite(file, cells.data(), sizeof(Uint32), cellCount);
+	}
+	if (!objects.empty()) SDL_RWwrite(file, objects.data(), sizeof(LevelFileObject), objects.size());
+	if (!vertices.empty()) SDL_RWwrite(file, vertices.data(), sizeof(LevelFileVertex), vertices.size());
+	if (!properties.empty()) SDL_RWwrite(file, properties.data(), sizeof(LevelFileProperty), properties.size());
+	SDL_RWwrite(file, strings.data(), 1, strings.size());
+
+	SDL_RWclose(file);
+	return true;
+}
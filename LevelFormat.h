@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include <SDL.h>
+
+using namespace std;
+
+// Everything the game needs out of a level file, in a form that doesn't depend on where it came from. Levels are made in Tiled and saved as .tmx files,
+// which are slow to load because they are XML with the tiles base64 encoded and compressed. The LevelCompiler tool turns them into .lvl files, which
+// are just these structs written out flat, so loading one is a single read and a few copies. The game still loads the .tmx file if there isn't a
+// compiled one (or if it's started with --tmx-levels), so levels can be changed in Tiled without recompiling them every time.
+
+// The first 4 bytes of every compiled level are "PLVL"
+#define LEVEL_FILE_MAGIC 0x4C564C50
+// This needs to go up whenever the layout of the file changes. Compiled levels with a different version aren't loaded
+#define LEVEL_FILE_VERSION 2
+
+enum class LevelPropertyType : Uint32 {
+	BOOL,
+	INT,
+	FLOAT,
+	STRING
+};
+
+// A custom property from Tiled. Numbers can be read as either an int or a float, since it's easy to make a property the wrong type in Tiled
+struct LevelProperty {
+	LevelPropertyType type = LevelPropertyType::INT;
+	int intValue = 0;
+	float floatValue = 0;
+	bool boolValue = false;
+	string stringValue;
+
+	int getIntValue() const { return type == LevelPropertyType::FLOAT ? (int)floatValue : intValue; }
+	float getFloatValue() const { return type == LevelPropertyType::INT ? (float)intValue : floatValue; }
+	bool getBoolValue() const { return boolValue; }
+	const string& getStringValue() const { return stringValue; }
+};
+
+// An object from the "collisions" layer, like a hitbox, a ladder or a moving platform. The position and points are in pixels, the same as in Tiled,
+// and the points are relative to the position
+struct LevelObject {
+	Uint32 uid = 0;
+	string type;
+	float x = 0;
+	float y = 0;
+	vector<SDL_FPoint> points;
+	unordered_map<string, LevelProperty> properties;
+
+	bool hasProperty(const string& name) const { return properties.count(name) > 0; }
+	// These return 0/false if the property isn't there
+	int getIntProperty(const string& name) const { auto property = properties.find(name); return property != properties.end() ? property->second.getIntValue() : 0; }
+	float getFloatProperty(const string& name) const { auto property = properties.find(name); return property != properties.end() ? property->second.getFloatValue() : 0; }
+	bool getBoolProperty(const string& name) const { auto property = properties.find(name); return property != properties.end() ? property->second.getBoolValue() : false; }
+};
+
+// A tileset image and the GIDs that it covers. The image path is already joined onto the map directory, so it can be loaded as it is
+struct LevelTileset {
+	Uint32 firstGID = 0;
+	Uint32 lastGID = 0;
+	string imagePath;
+};
+
+struct LevelData {
+	int width = 0;
+	int height = 0;
+	vector<LevelTileset> tilesets;
+	// Each layer is width * height GIDs stored row by row, in the order the layers are drawn
+	vector<vector<Uint32>> tileLayers;
+	vector<LevelObject> objects;
+};
+
+// Loads a level straight from a Tiled .tmx file. The tileset image paths in the map are relative to mapDirectory
+bool loadLevelFromTMX(const char* filename, string mapDirectory, LevelData* level);
+// Loads a level that was compiled by LevelCompiler. Returns false if the file doesn't exist, is from a different version or is broken
+bool loadCompiledLevel(const char* filename, LevelData* level);
+// Writes a level out in the compiled format
+bool writeCompiledLevel(const char* filename, const LevelData& level);
+
+// The layout of a compiled level. Everything is 4 byte little endian values, and every section starts on a 4 byte boundary. The header comes first
+// and says where each section is (as an offset from the start of the file) and how many things are in it. Strings are stored once in the string
+// section with a 0 at the end of each one, and everything else refers to them by their offset into that section
+struct LevelFileHeader {
+	Uint32 magic;
+	Uint32 version;
+	// The size of the whole file, so a cut off file can be caught
+	Uint32 fileSize;
+
+	Uint32 width;
+	Uint32 height;
+
+	Uint32 tilesetCount;
+	Uint32 tilesetOffset;
+	// Each layer is width * height Uint32 GIDs, one after the other
+	Uint32 layerCount;
+	Uint32 layerOffset;
+	Uint32 objectCount;
+	Uint32 objectOffset;
+	// The points of all of the objects are in one array, and each object says which part of it is theirs
+	Uint32 vertexCount;
+	Uint32 vertexOffset;
+	// Same for the properties
+	Uint32 propertyCount;
+	Uint32 propertyOffset;
+	Uint32 stringsSize;
+	Uint32 stringsOffset;
+};
+
+struct LevelFileTileset {
+	Uint32 firstGID;
+	Uint32 lastGID;
+	Uint32 imagePath;
+};
+
+struct LevelFileObject {
+	Uint32 uid;
+	Uint32 type;
+	float x;
+	float y;
+	Uint32 firstVertex;
+	Uint32 vertexCount;
+	Uint32 firstProperty;
+	Uint32 propertyCount;
+};
+
+struct LevelFileVertex {
+	float x;
+	float y;
+};
+
+struct LevelFileProperty {
+	Uint32 name;
+	LevelPropertyType type;
+	// Which one of these is used depends on the type. Bools are stored as an int
+	union {
+		Sint32 intValue;
+		float floatValue;
+		Uint32 stringValue;
+	};
+};
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string>
 #include <unordered_map>
+#include <memory>
 
 #include <SDL.h>
 #include <SDL_image.h>
@@ -16,9 +17,13 @@
 #include "FontHandler.h"
 #include "Box2dOverrides.h"
 #include "AudioHandler.h"
-
-#define PLAYER_BODY 1
-#define PLAYER_SENSOR 2
+#include "SpriteBatch.h"
+#include "TextureAtlas.h"
+#include "FramePacer.h"
+#include "FrameTelemetry.h"
+#include "Profiler.h"
+#include "AssetLoader.h"
+#include "ContactBenchmark.h"
 
 // These constants are the minimum distances that need to be between the playerand the edge of the viewport
 // They will be used in calculating when and by how much to scroll the vieport
@@ -26,6 +31,21 @@
 #define PLAYER_SPRITE_BOTTOM_MARGIN (int)(0.34 * SCREEN_HEIGHT)
 #define PLAYER_SPRITE_TOP_MARGIN (int)(0.266666 * SCREEN_HEIGHT)
 
+// The game logic and physics run at this fixed rate, no matter how fast frames are being drawn
+#define SIMULATION_RATE 80
+#define SIMULATION_TIMESTEP (1.0f / SIMULATION_RATE)
+// If a frame takes really long (like when the window is being dragged) we only catch up on this many steps instead of all of them
+#define MAX_TICKS_PER_FRAME 5
+// The bits of the key state byte that come from a single tap or click instead of a held key or button. These stay set until a simulation step
+// has seen them, otherwise a tap on a frame that doesn't run any steps would be lost
+#define ONE_SHOT_KEY_BITS 32
+// The player has to wait this many steps (200ms) between jumps
+#define JUMP_COOLDOWN_TICKS (SIMULATION_RATE / 5)
+// How long (in milliseconds) each frame can spend finishing off assets that were loaded in the background, like baking the chunks of a level
+#define ASSET_LOADING_FRAME_BUDGET 2.0
+// The loading screen has nothing else to do, so it can spend more of each frame on them
+#define ASSET_LOADING_SCREEN_BUDGET 8.0
+
 //#define MOBILE
 #undef MOBILE
 
@@ -36,6 +56,10 @@ public:
 	//The window we'll be rendering to
 	SDL_Window* window;
 
+	// Reads the command line options. This needs to be done before init() because some options change how the renderer is made
+	void parseArguments(int argc, char* args[]);
+	// Set by --bench-contacts. The contact benchmark is run instead of the game
+	bool benchmarkContacts = false;
 	bool init();
 	bool loadAssets();
 	void loop();
@@ -48,25 +72,50 @@ private:
 	int SCREEN_WIDTH = 1000;
 	int SCREEN_HEIGHT = 750;
 	int TILE_SIZE;
+	// The rate that frames are drawn at. This is separate from the simulation rate
 	int REFRESH_RATE;
 
+	// Waits between frames so that the game runs at the refresh rate. The mode can be picked with --pacing=vsync, --pacing=sleep or --pacing=hybrid
+	FramePacer framePacer;
+	FramePacingMode framePacingMode = FramePacingMode::HYBRID;
+
+	// Times each stage of every frame. The overlay is toggled by pressing F, P and S together, and --telemetry-csv=filename writes the timings to a file on exit
+	FrameTelemetry telemetry;
+	bool showTelemetry = false;
+	string telemetryCSVFilename;
+	// The overlay text only changes a few times a second so that it can actually be read
+	string telemetryOverlayText;
+
+	// Load the levels from the Tiled maps even if there are compiled levels. This is for making levels, so changes show up without recompiling them
+	bool loadTMXLevels = false;
+	// Stream every level instead of only the big ones. This is for testing streaming on the small levels
+	bool streamLevels = false;
+
+	// Where the profiler trace is written on exit. Only used when the game is built with PLATFORMER_PROFILING
+	string profileTraceFilename = "profile_trace.json";
+
 	// The window renderer. Needed for rendering textures
 	SDL_Renderer* renderer;
 	// Event handler
 	SDL_Event eventHandler;
+	// All of the sprites are drawn through this so that sprites with the same texture can be drawn together
+	SpriteBatch spriteBatch;
 
-	// The player texture
-	SDL_Texture* player;
+	// All of the sprite sheets and tilesets are packed into this atlas so that they share as few textures as possible
+	TextureAtlas textureAtlas;
+
+	// The player sprite sheet's place in the atlas
+	AtlasRegion player;
 	// Since the playe rhas multiple animation frames, we need to store an index to the current one. This is incremented by 32 (each texture is 32x32 px)
 	int playerTextureXOffset;
 	float animationFrameIndex;
 	bool playerDirection;
 
-	SDL_Texture* particleTexture;
-	// This texture has the sprites that are rendered on the level selection screen and the instructions screen
-	SDL_Texture* menuSprites;
-	// The texture that holds the touchscreen controls
-	SDL_Texture* controlsSpritesheet;
+	AtlasRegion particleTexture;
+	// This sprite sheet has the sprites that are rendered on the level selection screen and the instructions screen
+	AtlasRegion menuSprites;
+	// The sprite sheet that holds the touchscreen controls
+	AtlasRegion controlsSpritesheet;
 
 	// All of the levels will be in this array, including the level selection level
 	GameLevel maps[4];
@@ -75,6 +124,12 @@ private:
 	// they were on before they went into the level selection level
 	int naturalLevel;
 
+	// Only the level being played and the levels the player can go to from it are kept loaded. The others are loaded in the background by the
+	// asset loader before they are needed, and unloaded once the player can't reach them
+	AssetLoader assetLoader;
+	// The ID of the job loading each level, or 0 if the level isn't being loaded
+	int levelLoadJobs[4];
+
 	// The font handler class loads fonts and can draw them to the screen
 	FontHandler* fontHandler;
 	// This handles audio (obviously)
@@ -86,8 +141,20 @@ private:
 
 	// This world will contain all of the physics things and stuff. It does the heavy lifting
 	b2World* physicsWorld;
+	// The level that the physics world was built for. Restarting this level reuses the world and only remakes the things that move. -1 if there isn't a world
+	int physicsLevel = -1;
 	// We need a pointer the the player's body so we can get the coordinates from it
 	b2Body* playerBody;
+	// The user data of the player's fixtures. They don't belong to a level, so they live here instead of in a level's tag pool
+	FixtureTag playerBodyTag = { FixtureKind::PLAYER_BODY, -1, -1 };
+	FixtureTag playerSensorTag = { FixtureKind::PLAYER_SENSOR, -1, -1 };
+	FixtureTag particleTag = { FixtureKind::PARTICLE, -1, -1 };
+	// How many contacts the world has had each step since the current physics world was made. These are logged when the level changes and on exit
+	// so the contact filtering can be compared against --no-contact-filter
+	Uint64 contactCountTotal = 0;
+	Uint32 contactCountSteps = 0;
+	int contactCountPeak = 0;
+	void logContactStats();
 	// The instance to the collision callback class
 	CollisionListener* collisionListener;
 	// This class handles drawing the box2d fixtures and shapes for debugging
@@ -99,6 +166,10 @@ private:
 	struct DeathParticle {
 		b2Body* body;
 		char colorIndex;
+
+		// Where the particle was before the last simulation step. Used for smoothing out the movement when drawing
+		b2Vec2 previousPosition;
+		float previousAngle;
 	};
 	vector<Platformer::DeathParticle> deathParticles;
 
@@ -108,8 +179,19 @@ private:
 	#endif
 
 	// This is used for detecting if sufficient time has passed for the player to jump. We need this because when the player jumps, for a few milliseconds the sensor
-	// is still touchnig the ground. This means that a few more impulses will be applied, making the player jump really high and fast.
-	unsigned long playerJumpStartTime;
+	// is still touchnig the ground. This means that a few more impulses will be applied, making the player jump really high and fast. This is in simulation steps
+	unsigned long playerJumpStartTick;
+
+	// The number of simulation steps that have been run
+	unsigned long simulationTick;
+	// The time that hasn't been simulated yet, in seconds. Every frame adds its time to this and every simulation step takes SIMULATION_TIMESTEP away from it
+	double simulationAccumulator;
+	// The one shot bits of the key state byte that haven't been seen by a simulation step yet
+	Uint8 pendingOneShotKeyBits;
+	// The performance counter at the start of the last frame, used to work out how long each frame took
+	Uint64 previousFrameStartTime;
+	// Where the player was before the last simulation step. The player is drawn somewhere between this and their current position
+	b2Vec2 previousPlayerPosition;
 
 	unsigned long frameCount;
 
@@ -144,19 +226,28 @@ private:
 		}
 	};
 
-	// IDK y i still have this function tbh
-	SDL_Texture* loadTexture(const char* filename);
-
 	// The main loop for the screen where users actually play the game
 	void gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent);
+	// One fixed step of the game logic and physics
+	void gameScreenTick(Uint8 keyStateByte);
+	// Steps the physics world forwards and keeps track of how many contacts it had
+	void stepPhysics();
+	// Stores where everything is before a simulation step so it can be drawn between the two steps
+	void savePreviousTransforms();
 	// Main menu
 	void menuScreenLoop(bool pendingMouseEvent);
+	// Drawn while the assets are loading. The fonts and sprite sheets might not be loaded yet, so this is all drawn with rectangles
+	void loadingScreenLoop(int finishedJobs, int totalJobs);
 
 	void creditsScreenLoop(bool pendingMouseEvent);
 	void instructionsScreenLoop(bool pendingMouseEvent);
 
+	// Draws whatever is left in the sprite batch (and the telemetry overlay if it's on) and shows the frame on the screen
+	void presentFrame();
+	void drawTelemetryOverlay();
+
 	// Checks if any map scrolling is needed based on the players position
-	void checkScrolling();
+	void checkScrolling(b2Vec2 playerPosition);
 
 	void updatePlayerAnimation(bool movingSideways, bool movingVertical);
 
@@ -166,6 +257,19 @@ private:
 	bool arePointsInButton(const Button& button);
 
 	void createPhysics();
+	void createPlayer();
+	// Puts the player, entities and moving platforms back where they started without rebuilding the physics world. The static hitboxes stay as they are,
+	// so this only takes as long as the number of things that move, not the size of the level
+	void resetLevel();
+
+	// Switches to a level and sets up its physics. If the level wasn't loaded in time then this waits for it. Returns false (and quits) if it couldn't be loaded.
+	// Starting the level that is already being played (like when respawning) just resets it
+	bool startLevel(int level);
+	// Loads a level right now if it isn't loaded yet, finishing its background job if it has one
+	bool ensureLevelLoaded(int level);
+	void queueLevelLoad(int level);
+	// Starts loading the levels the player can go to from the current level and unloads the ones they can't
+	void prefetchLevels();
 
 	void writeUserData();
 
@@ -50,8 +50,7 @@ void Platformer::yesButton() {
 	}
 
 	// This will clear the physics for this world and setup the new stuff for next time. Even though we aren't switching level we still do this bcs it resets everything safely
-	createPhysics();
-	maps[currentLevel].createHitboxes(physicsWorld);
+	startLevel(currentLevel);
 }
 
 void Platformer::noButton() {
@@ -82,17 +81,14 @@ void Platformer::unmuteButton() {
 void Platformer::respawnButton() {
 	playerDead = false;
 	// This will clear the physics for this world and setup the new stuff for next time. Even though we aren't switching level we still do this bcs it resets everything safely
-	createPhysics();
-	maps[currentLevel].createHitboxes(physicsWorld);
+	startLevel(currentLevel);
 	Mix_ResumeMusic();
 }
 
 void Platformer::levelSelectButton() {
 	currentScreenType = screenTypes::GAME;
 	naturalLevel = currentLevel;
-	currentLevel = 0;
-	createPhysics();
-	maps[currentLevel].createHitboxes(physicsWorld);
+	startLevel(0);
 	if (!muted)
 		audioHandler.playMusic(audioHandler.GAME);
 }
\ No newline at end of file
@@ -3,12 +3,9 @@
 Platformer::Platformer() {
 	window = NULL;
 	renderer = NULL;
-	player = NULL;
 	playerTextureXOffset = 128;
 	animationFrameIndex = 0;
 	playerDirection = 1;
-	menuSprites = NULL;
-	controlsSpritesheet = NULL;
 	currentLevel = 1;
 	naturalLevel = 1;
 	fontHandler = NULL;
@@ -16,7 +13,12 @@ Platformer::Platformer() {
 	playerBody = NULL;
 	collisionListener = NULL;
 	debugDrawHitboxes = true;
-	playerJumpStartTime = 0;
+	playerJumpStartTick = 0;
+	simulationTick = 0;
+	simulationAccumulator = 0;
+	pendingOneShotKeyBits = 0;
+	previousFrameStartTime = 0;
+	previousPlayerPosition = b2Vec2(0, 0);
 	quit = false;
 	paused = false;
 	displayAreYouSure = false;
@@ -25,23 +27,16 @@ Platformer::Platformer() {
 	currentScreenType = screenTypes::MAIN_MENU;
 	frameCount = 0;
 	muted = false;
-	particleTexture = NULL;
 	TILE_SIZE = 0;
 	REFRESH_RATE = 0;
+	for (int i = 0; i < 4; i++)
+		levelLoadJobs[i] = 0;
 }
 
 // Free memory
 Platformer::~Platformer() {
-	// Delete the player sprite texture
-	SDL_DestroyTexture(player);
-	player = NULL;
-
-	SDL_DestroyTexture(menuSprites);
-	menuSprites = NULL;
-	SDL_DestroyTexture(particleTexture);
-	particleTexture = NULL;
-	SDL_DestroyTexture(controlsSpritesheet);
-	controlsSpritesheet = NULL;
+	// The loading thread might be in the middle of loading a level, so it has to be stopped before anything is destroyed
+	assetLoader.stop();
 
 	// Need to destroy font textures and game levels before destroying renderer
 	delete fontHandler;
@@ -50,12 +45,18 @@ Platformer::~Platformer() {
 	for (int i = 0; i < 4; i++)
 		maps[i].destroy();
 
+	// Delete the atlas pages. All of the sprite sheets and tilesets are in them. The levels give back their tilesets when they are destroyed, so this
+	// has to be done after them
+	textureAtlas.destroy();
+
 	// Destroy window and renderer. Need to destroy renderer before window
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	window = NULL;
 	renderer = NULL;
 
+	logContactStats();
+
 	// Destroy all of the physics objects
 	delete physicsWorld;
 	delete collisionListener;
@@ -63,7 +64,25 @@ Platformer::~Platformer() {
 	physicsWorld = NULL;
 	playerBody = NULL;
 
-	SDL_Log("%s%lu", "\nAverage FPS: ", frameCount / (SDL_GetTicks() / 1000));
+	// The game might not have run for a whole second if it quit early
+	if (SDL_GetTicks() >= 1000)
+		SDL_Log("%s%lu", "\nAverage FPS: ", frameCount / (SDL_GetTicks() / 1000));
+	// Every sprite used to be its own draw call, so this shows how many draw calls the sprite batch is saving. Older versions of SDL don't have
+	// SDL_RenderGeometry and draw every sprite on its own anyway, so there's nothing to compare
+	#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (frameCount > 0)
+		SDL_Log("Average sprites per frame: %lu, average sprite draw calls per frame: %lu", spriteBatch.spriteCount / frameCount, spriteBatch.drawCallCount / frameCount);
+	#else
+	SDL_Log("Sprite batching needs SDL 2.0.18 or newer for SDL_RenderGeometry, so every sprite was drawn on its own");
+	#endif
+	framePacer.logStats();
+	if (!telemetryCSVFilename.empty())
+		telemetry.writeCSV(telemetryCSVFilename);
+
+	#ifdef PLATFORMER_PROFILING
+	Profiler::writeTrace(profileTraceFilename);
+	Profiler::shutdown();
+	#endif
 	SDL_Delay(1000);
 
 	// Quit SDL subsystems
@@ -78,6 +97,42 @@ Platformer::~Platformer() {
 	cin >> pauseInput;*/
 }
 
+void Platformer::parseArguments(int argc, char* args[]) {
+	for (int i = 1; i < argc; i++) {
+		string argument = args[i];
+
+		if (argument.rfind("--pacing=", 0) == 0) {
+			if (!FramePacer::parseMode(argument.substr(9), &framePacingMode))
+				SDL_Log("Unknown frame pacing mode %s. The modes are vsync, sleep and hybrid", argument.substr(9).c_str());
+		}
+		else if (argument.rfind("--telemetry-csv=", 0) == 0) {
+			telemetryCSVFilename = argument.substr(16);
+		}
+		else if (argument == "--tmx-levels") {
+			loadTMXLevels = true;
+		}
+		else if (argument == "--stream-levels") {
+			streamLevels = true;
+		}
+		else if (argument == "--bench-contacts") {
+			benchmarkContacts = true;
+		}
+		else if (argument == "--no-contact-filter") {
+			setContactFiltering(false);
+		}
+		else if (argument.rfind("--profile-trace=", 0) == 0) {
+			profileTraceFilename = argument.substr(16);
+
+			#ifndef PLATFORMER_PROFILING
+			SDL_Log("The profiler isn't compiled in, so no trace will be written. Build with PLATFORMER_PROFILING defined to use it");
+			#endif
+		}
+		else {
+			SDL_Log("Unknown command line option %s", argument.c_str());
+		}
+	}
+}
+
 // Initialize physics, sdl and all of its libraries
 bool Platformer::init() {
 	// Initialize SDL
@@ -88,8 +143,9 @@ bool Platformer::init() {
 
 	SDL_DisplayMode DM;
 	SDL_GetCurrentDisplayMode(0, &DM);
-	REFRESH_RATE = 80; //REFRESH_RATE = DM.refresh_rate;
-	SDL_Log("Using a refresh rate of %d", REFRESH_RATE);
+	// Frames are drawn at the display's refresh rate. The game logic runs at its own fixed rate, so this doesn't change how fast the game plays
+	REFRESH_RATE = DM.refresh_rate > 0 ? DM.refresh_rate : 60;
+	SDL_Log("Using a refresh rate of %d and a simulation rate of %d", REFRESH_RATE, SIMULATION_RATE);
 
 	// Create window
 	window = SDL_CreateWindow("Platformer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT,/*DM.w, DM.h,*/ SDL_WINDOW_SHOWN);
@@ -98,14 +154,30 @@ bool Platformer::init() {
 		return false;
 	}
 
-	// Create renderer for window, making it use hardware acceleration
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED/* | SDL_RENDERER_PRESENTVSYNC*/);
+	// Let SDL group our draw calls together where it can. This is on by default unless a render driver is picked with a hint, but we want to be sure
+	SDL_SetHint(SDL_HINT_RENDER_BATCHING, "1");
+
+	// Create renderer for window, making it use hardware acceleration. Vsync is only turned on if the frame pacer is going to rely on it
+	Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+	if (framePacingMode == FramePacingMode::VSYNC) rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
+	renderer = SDL_CreateRenderer(window, -1, rendererFlags);
 	if (renderer == NULL)
 	{
 		printf("Renderer could not be created! SDL Error: %s\n", SDL_GetError());
 		return false;
 	}
 
+	// Some drivers ignore the vsync flag. Without it nothing would slow the game loop down, so we wait for frames ourselves instead
+	SDL_RendererInfo rendererInfo;
+	if (framePacingMode == FramePacingMode::VSYNC && (SDL_GetRendererInfo(renderer, &rendererInfo) != 0 || !(rendererInfo.flags & SDL_RENDERER_PRESENTVSYNC))) {
+		SDL_Log("The renderer doesn't support vsync, using hybrid frame pacing instead");
+		framePacingMode = FramePacingMode::HYBRID;
+	}
+	framePacer.setup(framePacingMode, REFRESH_RATE);
+
+	spriteBatch = SpriteBatch(renderer);
+	textureAtlas = TextureAtlas(renderer);
+
 	// Store the screen dimensions for use in rendering the textures at the correct coordinates
 	SDL_GetRendererOutputSize(renderer, &SCREEN_WIDTH, &SCREEN_HEIGHT);
 
@@ -137,7 +209,7 @@ bool Platformer::init() {
 	// This class will handle the stuff when the player touches the ground
 	collisionListener = new CollisionListener();
 	// For debugging
-	debugDrawer = Box2dDraw(renderer, SCREEN_HEIGHT, TILE_SIZE);
+	debugDrawer = Box2dDraw(renderer, SCREEN_WIDTH, SCREEN_HEIGHT, TILE_SIZE);
 	debugDrawer.SetFlags(b2Draw::e_shapeBit | b2Draw::e_centerOfMassBit);
 
 	return true;
@@ -145,6 +217,8 @@ bool Platformer::init() {
 
 // Loads the maps and the player
 bool Platformer::loadAssets() {
+	PROFILE_FUNCTION();
+
 	bool result = true;
 
 	// Get the user data from previous sessions of the game. This is stored in a text file. a+ is the best mode because we want to read and write, but not 
@@ -175,34 +249,106 @@ bool Platformer::loadAssets() {
 
 	SDL_RWclose(userDataFile);
 
+	for (int i = 0; i < 4; i++)
+		maps[i].setup(SCREEN_WIDTH, SCREEN_HEIGHT, TILE_SIZE, renderer, &spriteBatch, &textureAtlas, streamLevels);
+
+	// Everything below is loaded by the asset loader. The files are read and decoded on the loading threads while the main thread draws the loading screen
+	// and packs whatever has finished into the atlas, so loading takes as long as the slowest asset instead of all of them added together
+	Uint64 loadingStartTime = SDL_GetPerformanceCounter();
+	assetLoader.start(AssetLoader::getDefaultWorkerCount());
+	vector<int> loadingJobs;
+
+	// Pack the sprite sheets into the atlas. The tilesets are added to the atlas when the levels load
+	vector<string> spriteSheetNames = { "resources/menuSpritesheet.png", "resources/particles.png", "resources/controlsSpritesheet.png", "resources/playerSpritesheet.png" };
+	shared_ptr<vector<SDL_Surface*>> spriteSheetImages = make_shared<vector<SDL_Surface*>>(spriteSheetNames.size(), (SDL_Surface*)NULL);
+	loadingJobs.push_back(assetLoader.queueJob("sprite sheets", [spriteSheetNames, spriteSheetImages]() {
+		bool result = true;
+		for (int i = 0; i < spriteSheetNames.size(); i++) {
+			(*spriteSheetImages)[i] = TextureAtlas::loadImage(spriteSheetNames[i]);
+			if ((*spriteSheetImages)[i] == NULL) result = false;
+		}
+
+		// The main thread stage isn't run if this fails, so the images that did load need to be freed here
+		if (!result) {
+			for (SDL_Surface*& image : *spriteSheetImages) {
+				SDL_FreeSurface(image);
+				image = NULL;
+			}
+		}
+		return result;
+	}, [this, spriteSheetNames, spriteSheetImages]() {
+		vector<AtlasRegion> spriteSheets;
+		bool packed = textureAtlas.addSurfaces(spriteSheetNames, *spriteSheetImages, &spriteSheets);
+		for (SDL_Surface*& image : *spriteSheetImages) {
+			SDL_FreeSurface(image);
+			image = NULL;
+		}
+		if (!packed) return false;
+
+		menuSprites = spriteSheets[0];
+		particleTexture = spriteSheets[1];
+		controlsSpritesheet = spriteSheets[2];
+		player = spriteSheets[3];
+		return true;
+	}));
+
+	// Do some font stuff. SDL_ttf can only be used by one thread at a time, so all of the fonts are rasterized by the same job
+	fontHandler = new FontHandler(renderer, &spriteBatch, &textureAtlas);
+	vector<pair<string, int>> fonts = { { "button_font", 18 }, { "popup_font", 28 }, { "heading_font", 100 } };
+	shared_ptr<vector<FH_RasterizedFont>> rasterizedFonts = make_shared<vector<FH_RasterizedFont>>(fonts.size());
+	loadingJobs.push_back(assetLoader.queueJob("fonts", [this, fonts, rasterizedFonts]() {
+		for (int i = 0; i < fonts.size(); i++) {
+			if (!fontHandler->rasterizeFont("resources/fonts/joystix.ttf", fonts[i].second, &(*rasterizedFonts)[i])) return false;
+		}
+		return true;
+	}, [this, fonts, rasterizedFonts]() {
+		bool result = true;
+		for (int i = 0; i < fonts.size(); i++)
+			result = fontHandler->addRasterizedFont(fonts[i].first, &(*rasterizedFonts)[i]) && result;
+		return result;
+	}));
+
+	// Opening the music only reads the start of each file, but it is still slow enough to be worth doing on a loading thread. Nothing uses the audio
+	// handler until loading is finished
+	loadingJobs.push_back(assetLoader.queueJob("music", [this]() { return audioHandler.loadMusic(); }, nullptr));
+
+	// Only the current level is loaded now. The levels the player can go to from it are loaded in the background while they are in the menu
+	queueLevelLoad(currentLevel);
+	loadingJobs.push_back(levelLoadJobs[currentLevel]);
+
+	// Show the loading screen until everything is done
+	while (true) {
+		assetLoader.update(ASSET_LOADING_SCREEN_BUDGET);
+
+		int finishedJobs = 0;
+		for (int jobID : loadingJobs) {
+			if (assetLoader.isJobFinished(jobID))
+				finishedJobs++;
+		}
+		if (finishedJobs == loadingJobs.size()) break;
 
-	menuSprites = loadTexture("resources/menuSpritesheet.png");
-	particleTexture = loadTexture("resources/particles.png");
-	controlsSpritesheet = loadTexture("resources/controlsSpritesheet.png");
+		while (SDL_PollEvent(&eventHandler) == 1) {
+			// Closing the window while loading skips straight to quitting. The loading threads are stopped when the game is destroyed
+			if (eventHandler.type == SDL_QUIT) {
+				quit = true;
+				return true;
+			}
+		}
 
-	for (int i = 0; i < 4; i++) {
-		string mapName = "resources/maps/level " + to_string(i) + ".tmx";
-		result = maps[i].load(SCREEN_WIDTH, SCREEN_HEIGHT, TILE_SIZE, renderer, mapName.c_str(), "resources/maps/", physicsWorld);
-		if (!result) return false;
+		loadingScreenLoop(finishedJobs, (int)loadingJobs.size());
+		framePacer.waitForNextFrame();
 	}
 
-	// Load the player sprite
-	player = loadTexture("resources/playerSpritesheet.png");
+	// Any failures were already logged by the asset loader
+	for (int jobID : loadingJobs) {
+		if (!assetLoader.finishJob(jobID)) return false;
+	}
 
-	// Setup the physics for the current level in advance
-	createPhysics();
-	maps[currentLevel].createHitboxes(physicsWorld);
+	SDL_Log("Loaded everything in %.2fms", (double)(SDL_GetPerformanceCounter() - loadingStartTime) * 1000.0 / SDL_GetPerformanceFrequency());
+	SDL_Log("Packed the sprite sheets, tilesets and fonts into %d atlas page(s)", textureAtlas.getPageCount());
 
-	// Do some font stuff
-	fontHandler = new FontHandler(renderer);
-	result = fontHandler->loadFont("button_font", "resources/fonts/joystix.ttf", 18);
-	if (!result) return false;
-	result = fontHandler->loadFont("popup_font", "resources/fonts/joystix.ttf", 28);
-	if (!result) return false;
-	result = fontHandler->loadFont("heading_font", "resources/fonts/joystix.ttf", 100);
-	if (!result) return false;
-
-	result = audioHandler.loadMusic();
+	// Setup the physics for the current level in advance. The level is already loaded, so this doesn't need to wait
+	result = startLevel(currentLevel);
 	if (!result) return false;
 
 	if(!muted)
@@ -216,27 +362,49 @@ void Platformer::loop() {
 	// The timestamp of the last box2d debug draw toggle. Only used on mobile. This is to only make the debug draw toggle once during a multigesture.
 	Uint32 ddPrevTimestamp = 0;
 
+	PROFILE_THREAD_NAME("Main thread");
+
 	// Keep looping until the user quits the game
 	while (quit == false) {
+		PROFILE_ZONE("Frame");
+
 		Uint64 startTime = SDL_GetPerformanceCounter();
+		telemetry.beginFrame();
 
 		frameCount++;
 
+		// The time since the last frame is added to the simulation accumulator. The game screen uses this to decide how many simulation steps to run.
+		// The other screens don't simulate anything, so the time is thrown away to stop it building up
+		if (currentScreenType == screenTypes::GAME && previousFrameStartTime != 0)
+			simulationAccumulator += (double)(startTime - previousFrameStartTime) / (double)SDL_GetPerformanceFrequency();
+		else
+			simulationAccumulator = 0;
+		previousFrameStartTime = startTime;
+
 		bool pendingMouseEvent = false;
 		bool pendingKeyEvent = false;
 
+		Uint64 stageStartTime = SDL_GetPerformanceCounter();
 		// Loop through every event until we have handled them all
 		while (SDL_PollEvent(&eventHandler) == 1) {
+			PROFILE_ZONE("Handle event");
+
 			// User requests to quit the application
 			if (eventHandler.type == SDL_QUIT) {
 				printf("Quitting\n");
 				quit = true;
 			}
 
+			// Some renderers (like direct3d) lose the contents of render target textures when the device is reset. The baked tile chunks need to be redrawn
+			else if (eventHandler.type == SDL_RENDER_TARGETS_RESET) {
+				for (int i = 0; i < 4; i++)
+					maps[i].bakeChunks();
+			}
+
 			// Handle keyboard events if we are on non-mobile
 			#ifndef MOBILE
 			else if (eventHandler.type == SDL_MOUSEBUTTONUP && eventHandler.button.button == SDL_BUTTON_LEFT) {
-				//maps[currentLevel].dumpMovingPlatformData(false, NULL);
+				//maps[currentLevel].dumpMovingPlatformData(34);
 				pendingMouseEvent = true;
 			}
 			else if (eventHandler.type == SDL_KEYDOWN) {
@@ -251,6 +419,12 @@ void Platformer::loop() {
 					debugDrawHitboxes = !debugDrawHitboxes;
 					cout << "Box2d debugging toggled\n";
 				}
+				// Toggle the frame timing overlay
+				if (keyStates[SDL_SCANCODE_F] && keyStates[SDL_SCANCODE_P] && keyStates[SDL_SCANCODE_S]) {
+					showTelemetry = !showTelemetry;
+					telemetryOverlayText.clear();
+					cout << "Frame telemetry overlay toggled\n";
+				}
 			}
 
 			// Otherwise we need to deal with the touchscreen
@@ -283,6 +457,10 @@ void Platformer::loop() {
 			}
 			#endif
 		}
+		telemetry.addStageTime(TELEMETRY_EVENTS, stageStartTime);
+
+		// Finish off any levels that were loaded in the background
+		assetLoader.update(ASSET_LOADING_FRAME_BUDGET);
 
 		// Set renderer color back to light blue because it will be changed for drawing primitives
 		SDL_SetRenderDrawColor(renderer, 181, 227, 255, 255);
@@ -305,27 +483,69 @@ void Platformer::loop() {
 			break;
 		}
 
-		Uint64 endTime = SDL_GetPerformanceCounter();
-		float elapsedTime = (float)(endTime - startTime) / (float)SDL_GetPerformanceFrequency();
-		while (elapsedTime < 1.0 / (float)REFRESH_RATE) {
-			float sleepingTime = (1.0 / (float)REFRESH_RATE - elapsedTime) * 1000.0;
-			if (sleepingTime > 0) SDL_Delay((Uint32)sleepingTime);
-
-			// Update the elapsed time. This is because the delay function cant go less than 1 ms. For example, if there is 1.75 ms until the next tick,
-			// We will sleep for 1 ms but there will still be that 0.75 left over. For that, we just spin in the while loop
-			endTime = SDL_GetPerformanceCounter();
-			elapsedTime = (float)(endTime - startTime) / (float)SDL_GetPerformanceFrequency();
+		// Wait until it's time for the next frame
+		stageStartTime = SDL_GetPerformanceCounter();
+		{
+			PROFILE_ZONE("Wait for next frame");
+			framePacer.waitForNextFrame();
 		}
+		telemetry.addStageTime(TELEMETRY_WAIT, stageStartTime);
+
+		telemetry.endFrame();
 	}
 
 	// If the music isn't stopped before exiting SDL_mixer seems to crash
 	Mix_HaltMusic();
 }
 
+void Platformer::presentFrame() {
+	PROFILE_FUNCTION();
+
+	// The overlay isn't counted as part of presenting, so it doesn't change the numbers it's showing too much
+	if (showTelemetry)
+		drawTelemetryOverlay();
+
+	Uint64 stageStartTime = SDL_GetPerformanceCounter();
+	spriteBatch.flush();
+	SDL_RenderPresent(renderer);
+	telemetry.addStageTime(TELEMETRY_PRESENT, stageStartTime);
+}
+
+void Platformer::drawTelemetryOverlay() {
+	// Work out the stats again every half a second. Every frame would be too fast to read
+	if (telemetryOverlayText.empty() || frameCount % (REFRESH_RATE / 2 + 1) == 0) {
+		char line[64];
+		snprintf(line, sizeof(line), "%-8s%7s%7s%7s", "ms", "min", "avg", "p99");
+		telemetryOverlayText = line;
+
+		// The whole frame goes at the bottom, after all of the stages
+		for (int stage = 0; stage <= TELEMETRY_STAGE_COUNT; stage++) {
+			TelemetryStats stats = telemetry.getStats(stage);
+			snprintf(line, sizeof(line), "\n%-8s%7.2f%7.2f%7.2f", FrameTelemetry::getStageName(stage), stats.min, stats.average, stats.p99);
+			telemetryOverlayText += line;
+		}
+	}
+
+	int characterWidth, characterHeight;
+	if (!fontHandler->getFontSize("button_font", &characterWidth, &characterHeight)) return;
+
+	// A see through box behind the text so it can be read on top of the level. Every line is the same length
+	int lineCount = TELEMETRY_STAGE_COUNT + 2;
+	SDL_Rect rectangle = { 10, 10, characterWidth * 29 + 20, characterHeight * lineCount + 20 };
+
+	spriteBatch.flush();
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 200);
+	SDL_RenderFillRect(renderer, &rectangle);
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+	fontHandler->renderFont("button_font", telemetryOverlayText, rectangle.x + rectangle.w / 2, rectangle.y + rectangle.h / 2);
+}
+
 // Checks if any map scrolling is needed based on the players position
-void Platformer::checkScrolling() {
-	float xPos = (playerBody->GetPosition().x - 0.5) * TILE_SIZE;
-	float yPos = SCREEN_HEIGHT - ((playerBody->GetPosition().y + 0.5) * TILE_SIZE);
+void Platformer::checkScrolling(b2Vec2 playerPosition) {
+	float xPos = (playerPosition.x - 0.5) * TILE_SIZE;
+	float yPos = SCREEN_HEIGHT - ((playerPosition.y + 0.5) * TILE_SIZE);
 
 	// If the distance from the player's left side to the left side of the viewport is less than the minimum margin
 	// then we need to calculate how much we need to change the viewport by
@@ -361,7 +581,7 @@ void Platformer::updatePlayerAnimation(bool movingSideways, bool movingVertical)
 		}
 		else {
 			playerTextureXOffset = 32 * ((int)animationFrameIndex % 3) + 96;
-			animationFrameIndex += 1.0 / ((float)REFRESH_RATE / 8.0);
+			animationFrameIndex += 1.0 / ((float)SIMULATION_RATE / 8.0);
 			if (animationFrameIndex >= 3) animationFrameIndex = 0.0;
 		}
 	}
@@ -369,7 +589,7 @@ void Platformer::updatePlayerAnimation(bool movingSideways, bool movingVertical)
 	else if (collisionListener->playerLadderContacts > 0) {
 		if (movingVertical) {
 			playerTextureXOffset = 32 * ((int)animationFrameIndex % 2);
-			animationFrameIndex += 1.0 / ((float)REFRESH_RATE / 8.0);
+			animationFrameIndex += 1.0 / ((float)SIMULATION_RATE / 8.0);
 			if (animationFrameIndex >= 2) animationFrameIndex = 0.0;
 		}
 		else {
@@ -385,6 +605,8 @@ void Platformer::updatePlayerAnimation(bool movingSideways, bool movingVertical)
 }
 
 void Platformer::createPhysics() {
+	PROFILE_FUNCTION();
+
 	// If the user is respawning this function will be called. If they are respawning, the player was previously dead and had particles. We need to delete them
 	deathParticles.clear();
 
@@ -399,6 +621,10 @@ void Platformer::createPhysics() {
 	physicsWorld->SetContactListener(collisionListener);
 	physicsWorld->SetDebugDraw(&debugDrawer);
 
+	createPlayer();
+}
+
+void Platformer::createPlayer() {
 	// Create a dynamic body for the player
 	b2BodyDef playerBodyDef;
 	playerBodyDef.type = b2_dynamicBody;
@@ -416,7 +642,8 @@ void Platformer::createPhysics() {
 	playerFixture.shape = &collisionShape;
 	playerFixture.density = 1.0;
 	playerFixture.friction = 0.0;
-	playerFixture.userData = (void*)PLAYER_BODY;
+	playerFixture.userData = &playerBodyTag;
+	playerFixture.filter = getFixtureFilter(FixtureKind::PLAYER_BODY);
 	playerBody->CreateFixture(&playerFixture);
 
 	// This will be a sensor fixture. It will detect if the player is touching the ground
@@ -424,21 +651,147 @@ void Platformer::createPhysics() {
 	collisionShape.SetAsBox(0.38, 0.1, b2Vec2(0, -0.48), 0);
 	playerSensorFixtureDef.isSensor = true;
 	playerSensorFixtureDef.shape = &collisionShape;
+	playerSensorFixtureDef.filter = getFixtureFilter(FixtureKind::PLAYER_SENSOR);
 	b2Fixture* playerSensorFixture = playerBody->CreateFixture(&playerSensorFixtureDef);
-	playerSensorFixture->SetUserData((void*)PLAYER_SENSOR);
+	playerSensorFixture->SetUserData(&playerSensorTag);
 
 	collisionListener->SetPlayerBody(playerBody);
+	previousPlayerPosition = playerBody->GetPosition();
 }
 
-SDL_Texture* Platformer::loadTexture(const char* filename) {
-	// Load the image and then create the texture it
-	SDL_Surface* surface = IMG_Load(filename);
-	SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+bool Platformer::startLevel(int level) {
+	PROFILE_FUNCTION();
+
+	if (!ensureLevelLoaded(level)) {
+		SDL_Log("Couldn't load level %d", level);
+		quit = true;
+		return false;
+	}
+
+	// Respawning and restarting start the same level again, and the world already has its hitboxes in it
+	if (level == physicsLevel && physicsWorld != NULL) {
+		currentLevel = level;
+		resetLevel();
+		return true;
+	}
 
-	// We can free the unused surface as we no longer need it because we have a texture
-	SDL_FreeSurface(surface);
+	logContactStats();
+
+	currentLevel = level;
+	createPhysics();
+	maps[currentLevel].createHitboxes(physicsWorld);
+	// Every platform gets a button counter, even if it has no button, so the listener never has to make room for one
+	collisionListener->buttons.assign(maps[currentLevel].getMovingPlatformCount(), 0);
+	physicsLevel = currentLevel;
+
+	prefetchLevels();
+
+	return true;
+}
+
+void Platformer::logContactStats() {
+	if (contactCountSteps > 0)
+		SDL_Log("Level %d had %.1f contacts per step on average and %d at most, over %u steps", physicsLevel, (double)contactCountTotal / contactCountSteps, contactCountPeak, contactCountSteps);
+
+	contactCountTotal = 0;
+	contactCountSteps = 0;
+	contactCountPeak = 0;
+}
+
+void Platformer::resetLevel() {
+	PROFILE_FUNCTION();
+	Uint64 resetStartTime = SDL_GetPerformanceCounter();
+
+	// Destroying the bodies ends their contacts, which takes them back off of the collision listener's counters
+	for (DeathParticle& deathParticle : deathParticles)
+		physicsWorld->DestroyBody(deathParticle.body);
+	deathParticles.clear();
+
+	if (playerBody != NULL) {
+		physicsWorld->DestroyBody(playerBody);
+		collisionListener->nullPlayerBody();
+		playerBody = NULL;
+	}
+
+	maps[currentLevel].resetDynamicBodies();
+
+	// Everything that could have touched a sensor has been remade, so this should already be clear. It's cleared anyway so nothing from the last
+	// attempt can carry over
+	collisionListener->clear();
+	createPlayer();
+
+	SDL_Log("Reset level %d in %.2fms", currentLevel, (double)(SDL_GetPerformanceCounter() - resetStartTime) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+bool Platformer::ensureLevelLoaded(int level) {
+	if (maps[level].isLoaded()) return true;
+
+	if (levelLoadJobs[level] == 0)
+		queueLevelLoad(level);
+
+	// If this happens when switching levels then the prefetch didn't finish in time (or the level wasn't prefetched), so the game will hitch
+	Uint64 waitStartTime = SDL_GetPerformanceCounter();
+	assetLoader.finishJob(levelLoadJobs[level]);
+	levelLoadJobs[level] = 0;
+	SDL_Log("Waited %.2fms for level %d to load", (double)(SDL_GetPerformanceCounter() - waitStartTime) * 1000.0 / SDL_GetPerformanceFrequency(), level);
+
+	// A level that failed part way through loading still has some of its data, so it is cleared out
+	if (!maps[level].isLoaded()) {
+		maps[level].unload();
+		return false;
+	}
+
+	return true;
+}
+
+void Platformer::queueLevelLoad(int level) {
+	string mapName = "resources/maps/level " + to_string(level);
+	GameLevel* map = &maps[level];
+	bool loadTMX = loadTMXLevels;
+
+	levelLoadJobs[level] = assetLoader.queueJob(mapName, [map, mapName, loadTMX]() { return map->prepare(mapName, "resources/maps/", loadTMX); }, [map]() { return map->finishLoading(); });
+}
+
+void Platformer::prefetchLevels() {
+	// From the level selection level the player can only go back to the level they were on (through the main menu) or into any of the other
+	// levels, which we can't guess. From any other level they can go to the next level or the level selection level
+	bool keepLevel[4] = { false, false, false, false };
+	keepLevel[currentLevel] = true;
+	if (currentLevel == 0)
+		keepLevel[naturalLevel] = true;
+	else {
+		keepLevel[currentLevel == 3 ? 1 : currentLevel + 1] = true;
+		keepLevel[0] = true;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		// Forget about jobs that have finished. If the job failed then the level might have half of its data, so that is cleared
+		if (levelLoadJobs[i] != 0 && assetLoader.isJobFinished(levelLoadJobs[i])) {
+			levelLoadJobs[i] = 0;
+			if (!maps[i].isLoaded())
+				maps[i].unload();
+		}
+
+		// A level that is still being loaded can't be unloaded until its job is done, since the loading thread is using it
+		if (levelLoadJobs[i] != 0) continue;
+
+		if (keepLevel[i] && !maps[i].isLoaded())
+			queueLevelLoad(i);
+		else if (!keepLevel[i] && maps[i].isLoaded())
+			maps[i].unload();
+	}
+}
+
+void Platformer::savePreviousTransforms() {
+	if (playerBody != NULL)
+		previousPlayerPosition = playerBody->GetPosition();
+
+	for (DeathParticle& deathParticle : deathParticles) {
+		deathParticle.previousPosition = deathParticle.body->GetPosition();
+		deathParticle.previousAngle = deathParticle.body->GetAngle();
+	}
 
-	return texture;
+	maps[currentLevel].savePreviousTransforms();
 }
 
 // Checks if the given point is inside a button. Utility function
@@ -1,7 +1,40 @@
 #include "Platformer.h"
 
+void Platformer::loadingScreenLoop(int finishedJobs, int totalJobs) {
+	PROFILE_FUNCTION();
+
+	// The same light blue as the rest of the game
+	SDL_SetRenderDrawColor(renderer, 181, 227, 255, 255);
+	SDL_RenderClear(renderer);
+
+	// The progress bar
+	int barWidth = SCREEN_WIDTH / 2;
+	int barHeight = TILE_SIZE / 2;
+	SDL_Rect rectangle = { SCREEN_WIDTH / 2 - barWidth / 2, SCREEN_HEIGHT / 2 - barHeight / 2, barWidth, barHeight };
+	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+	SDL_RenderFillRect(renderer, &rectangle);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+	SDL_RenderDrawRect(renderer, &rectangle);
+
+	rectangle.w = totalJobs > 0 ? barWidth * finishedJobs / totalJobs : 0;
+	SDL_RenderFillRect(renderer, &rectangle);
+
+	// Some squares above the bar hop one after the other so it's obvious that the game hasn't frozen, even when the bar isn't moving
+	float time = SDL_GetTicks() / 1000.0f;
+	int squareSize = TILE_SIZE / 3;
+	for (int i = 0; i < 3; i++) {
+		float hop = max(0.0f, sinf(time * 6 - i * 0.8f));
+		rectangle = { SCREEN_WIDTH / 2 + (i - 1) * squareSize * 2 - squareSize / 2, (int)(SCREEN_HEIGHT / 2 - barHeight - squareSize * (1 + hop)), squareSize, squareSize };
+		SDL_RenderFillRect(renderer, &rectangle);
+	}
+
+	SDL_RenderPresent(renderer);
+}
+
 // The main loop for the screen that users see when they first start the game
 void Platformer::menuScreenLoop(bool pendingMouseEvent) {
+	PROFILE_FUNCTION();
+
 	if (!muted)
 		audioHandler.checkForTrackEnd();
 
@@ -42,6 +75,9 @@ void Platformer::menuScreenLoop(bool pendingMouseEvent) {
 
 	// If it's true, then we need to draw the popup. Users can confirm they want to exit and that they didn't press it by accident
 	if (displayAreYouSure == true) {
+		// The popup needs to go on top of the sprites that are waiting in the batch
+		spriteBatch.flush();
+
 		// Popup body
 		rectangle = {SCREEN_WIDTH / 2 - 225, SCREEN_HEIGHT / 4 - 90, 450, 180};
 		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
@@ -121,12 +157,14 @@ void Platformer::menuScreenLoop(bool pendingMouseEvent) {
 	}
 	#endif
 
-	// Show everything on the screen
-	SDL_RenderPresent(renderer);
+	// Draw whatever is left in the sprite batch and then show everything on the screen
+	presentFrame();
 }
 
 // The main loop for the screen where users actually play the game
 void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
+	PROFILE_FUNCTION();
+
 	if (!muted)
 		audioHandler.checkForTrackEnd();
 
@@ -199,6 +237,10 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 
 	#endif
 
+	// Taps from earlier frames that didn't get to run a simulation step still count
+	pendingOneShotKeyBits |= keyStateByte & ONE_SHOT_KEY_BITS;
+	keyStateByte |= pendingOneShotKeyBits;
+
 	if (keyStateByte & 16 && !displayAreYouSure) {
 		if (paused)
 			Mix_ResumeMusic();
@@ -208,38 +250,83 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 		paused = !paused;
 	}
 
+	//## ---- SIMULATION ---- ##//
+
+	// The game logic runs in fixed steps. Every frame adds the time it took to the accumulator, and we run as many steps as fit into it. Whatever is left over is
+	// used to blend between the last two steps when drawing, so movement still looks smooth when the frame rate and the simulation rate don't line up.
+	// The physics keep going while the player is dead so the death particles can fly around, but nothing moves while a popup is open
+	Uint64 stageStartTime = SDL_GetPerformanceCounter();
+	// Bring in the parts of the level around the camera before the physics steps, so the hitboxes near the player are always there
+	maps[currentLevel].updateStreaming(camXOffset, camYOffset);
+
+	if (playerDead || (paused == false && displayAreYouSure == false)) {
+		// Don't try to catch up on loads of steps after a really long frame (like when the window is being dragged)
+		simulationAccumulator = min(simulationAccumulator, MAX_TICKS_PER_FRAME * (double)SIMULATION_TIMESTEP);
+
+		while (simulationAccumulator >= SIMULATION_TIMESTEP) {
+			savePreviousTransforms();
+			gameScreenTick(keyStateByte);
+			simulationAccumulator -= SIMULATION_TIMESTEP;
+
+			// A tap only happens once, so only the first step gets it
+			pendingOneShotKeyBits = 0;
+			keyStateByte &= ~ONE_SHOT_KEY_BITS;
+		}
+	}
+	else {
+		// Nothing is moving, so the previous state is the same as the current one. A tap while the game is paused shouldn't go off when it's resumed
+		simulationAccumulator = 0;
+		pendingOneShotKeyBits = 0;
+		savePreviousTransforms();
+	}
+	telemetry.addStageTime(TELEMETRY_LOGIC, stageStartTime);
+
+	// How far we are between the previous step and the current one, from 0 to 1
+	float interpolation = (float)(simulationAccumulator / SIMULATION_TIMESTEP);
+
+	// The camera follows where the player is drawn, not where the physics has them
+	if (playerBody != NULL && !playerDead)
+		checkScrolling(previousPlayerPosition + interpolation * (playerBody->GetPosition() - previousPlayerPosition));
+
 	//## ---- DRAWING CODE ---- ##\\
 
 	// Draw the level
-	maps[currentLevel].render(camXOffset, camYOffset);
+	stageStartTime = SDL_GetPerformanceCounter();
+	maps[currentLevel].render(camXOffset, camYOffset, interpolation);
+	telemetry.addStageTime(TELEMETRY_LEVEL_RENDER, stageStartTime);
 
 	SDL_Rect rectangle;
 	SDL_Rect sourceRect;
 
 	if (!playerDead) {
-		b2Vec2 playerPosVector = playerBody->GetPosition();
+		b2Vec2 playerPosVector = previousPlayerPosition + interpolation * (playerBody->GetPosition() - previousPlayerPosition);
 		//  We need to take the camera offset into account
 		rectangle = { (int)((playerPosVector.x - 0.5) * TILE_SIZE - camXOffset), (int)(SCREEN_HEIGHT - ((playerPosVector.y + 0.5) * TILE_SIZE) - camYOffset), TILE_SIZE, TILE_SIZE };
-		sourceRect = { playerTextureXOffset, 0, 32, 32 };
+		sourceRect = player.getSourceRect(playerTextureXOffset, 0, 32, 32);
 		// Draw the player sprite at its position.
-		SDL_RenderCopyEx(renderer, player, &sourceRect, &rectangle, 0, NULL, (playerDirection) ? SDL_RendererFlip::SDL_FLIP_NONE : SDL_RendererFlip::SDL_FLIP_HORIZONTAL);
+		spriteBatch.draw(player.texture, &sourceRect, &rectangle, 0, (playerDirection) ? SDL_RendererFlip::SDL_FLIP_NONE : SDL_RendererFlip::SDL_FLIP_HORIZONTAL);
 	}
 	// If the player is dead then we want to render the death particles
 	else {
 		int particleSize = TILE_SIZE / 4;
 		for (auto& deathParticle : deathParticles) {
-			b2Vec2 p = deathParticle.body->GetPosition();
-			sourceRect = { (deathParticle.colorIndex % 4) * 8, (deathParticle.colorIndex % 4) * 8, 8, 8 };
+			b2Vec2 p = deathParticle.previousPosition + interpolation * (deathParticle.body->GetPosition() - deathParticle.previousPosition);
+			float angle = deathParticle.previousAngle + interpolation * (deathParticle.body->GetAngle() - deathParticle.previousAngle);
+			sourceRect = particleTexture.getSourceRect((deathParticle.colorIndex % 4) * 8, (deathParticle.colorIndex % 4) * 8, 8, 8);
 			rectangle = { (int)((p.x - 1.0 / 8.0) * TILE_SIZE - camXOffset), (int)(SCREEN_HEIGHT - ((p.y + 1.0 / 8.0) * TILE_SIZE) - camYOffset), particleSize, particleSize };
 
-			SDL_RenderCopyEx(renderer, particleTexture, &sourceRect, &rectangle, (double)deathParticle.body->GetAngle() * -180.0 / b2_pi, NULL, SDL_FLIP_NONE);
+			spriteBatch.draw(particleTexture.texture, &sourceRect, &rectangle, (double)angle * -180.0 / b2_pi);
 		}
 	}
 
 	if (debugDrawHitboxes == true) {
-		// Draw the box2d stuff for debugging
+		// Draw the box2d stuff for debugging. The sprites need to be drawn first so that the hitboxes go on top of them
+		spriteBatch.flush();
+		stageStartTime = SDL_GetPerformanceCounter();
+		PROFILE_ZONE("Debug draw");
 		debugDrawer.updateCameraOffset(camXOffset, camYOffset);
-		physicsWorld->DebugDraw();
+		debugDrawer.drawWorld(physicsWorld);
+		telemetry.addStageTime(TELEMETRY_DEBUG_DRAW, stageStartTime);
 	}
 
 	// If the user is playing on mobile, then we want to draw the controls
@@ -247,34 +334,37 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 	// Render left and right controls
 	for (uint8 i = 0; i < 2; i++) {
 		rectangle = { (int)(TILE_SIZE * (i * 1.875 + 0.625)), SCREEN_HEIGHT - (int)(TILE_SIZE * 1.875), (int)(TILE_SIZE * 1.25), (int)(TILE_SIZE * 1.25) };
-		sourceRect = { i * 80, 0, 80, 80 };
-		SDL_RenderCopy(renderer, controlsSpritesheet, &sourceRect, &rectangle);
+		sourceRect = controlsSpritesheet.getSourceRect(i * 80, 0, 80, 80);
+		spriteBatch.draw(controlsSpritesheet.texture, &sourceRect, &rectangle);
 	}
 
 	// Render up and down controls
 	for (uint8 i = 0; i < 2; i++) {
 		rectangle = { SCREEN_WIDTH - (int)(TILE_SIZE * 1.875), SCREEN_HEIGHT - (int)(TILE_SIZE * (i * 1.875 + 1.875)), (int)(TILE_SIZE * 1.25), (int)(TILE_SIZE * 1.25) };
-		sourceRect = { i * 80 + 160, 0, 80, 80 };
-		SDL_RenderCopy(renderer, controlsSpritesheet, &sourceRect, &rectangle);
+		sourceRect = controlsSpritesheet.getSourceRect(i * 80 + 160, 0, 80, 80);
+		spriteBatch.draw(controlsSpritesheet.texture, &sourceRect, &rectangle);
 	}
 
 	// Render enter level button if we are on the level selection screen
 	if (currentLevel == 0) {
 		rectangle = { SCREEN_WIDTH - (int)(TILE_SIZE * 3.375), SCREEN_HEIGHT - (int)(TILE_SIZE * 2.8125), (int)(TILE_SIZE * 1.25), (int)(TILE_SIZE * 1.25) };
-		sourceRect = { 320, 0, 80, 80 };
-		SDL_RenderCopy(renderer, controlsSpritesheet, &sourceRect, &rectangle);
+		sourceRect = controlsSpritesheet.getSourceRect(320, 0, 80, 80);
+		spriteBatch.draw(controlsSpritesheet.texture, &sourceRect, &rectangle);
 	}
 	#endif
 
 	// Render pause button
 	rectangle = { SCREEN_WIDTH - (int)(TILE_SIZE * 1.5), (int)(TILE_SIZE * 0.5), TILE_SIZE, TILE_SIZE };
-	sourceRect = { 400, 0, 48, 48 };
-	SDL_RenderCopy(renderer, controlsSpritesheet, &sourceRect, &rectangle);
+	sourceRect = controlsSpritesheet.getSourceRect(400, 0, 48, 48);
+	spriteBatch.draw(controlsSpritesheet.texture, &sourceRect, &rectangle);
 
 	vector<Button> buttons;
 
 	// If it's true, then we need to draw the popup. Users can confirm they want to exit or restart and that they didn't press the button by accident
 	if (displayAreYouSure == true) {
+		// The popup needs to go on top of the sprites that are waiting in the batch
+		spriteBatch.flush();
+
 		// Popup body
 		rectangle = { SCREEN_WIDTH / 2 - 225, SCREEN_HEIGHT / 4 - 90, 450, 180 };
 		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
@@ -292,6 +382,9 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 	else if (paused == true) {
 		rectangle = { SCREEN_WIDTH / 2 - 225, SCREEN_HEIGHT / 4 - 95, 450, 250 };
 
+		// The popup needs to go on top of the sprites that are waiting in the batch
+		spriteBatch.flush();
+
 		// The popup body
 		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
 		SDL_RenderFillRect(renderer, &rectangle);
@@ -309,6 +402,9 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 	else if (playerDead == true) {
 		rectangle = {SCREEN_WIDTH / 2 - 225, SCREEN_HEIGHT / 4 - 90, 450, 180};
 
+		// The popup needs to go on top of the sprites that are waiting in the batch
+		spriteBatch.flush();
+
 		// The popup body
 		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
 		SDL_RenderFillRect(renderer, &rectangle);
@@ -401,21 +497,38 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 	}
 	#endif
 
-	// Render everything to the screen
-	SDL_RenderPresent(renderer);
+	// Draw whatever is left in the sprite batch and then render everything to the screen
+	presentFrame();
 
 	//##------------------------##//
+}
 
+void Platformer::stepPhysics() {
+	Uint64 stageStartTime = SDL_GetPerformanceCounter();
+	{
+		PROFILE_ZONE("b2World::Step");
+		physicsWorld->Step(SIMULATION_TIMESTEP, 8, 3);
+	}
+	telemetry.addStageTime(TELEMETRY_PHYSICS_STEP, stageStartTime);
+
+	int contactCount = physicsWorld->GetContactCount();
+	contactCountTotal += contactCount;
+	contactCountSteps++;
+	contactCountPeak = max(contactCountPeak, contactCount);
+}
+
+// One fixed step of the game logic and physics. This is run SIMULATION_RATE times a second by gameScreenLoop, no matter how fast frames are being drawn
+void Platformer::gameScreenTick(Uint8 keyStateByte) {
+	PROFILE_FUNCTION();
+
+	simulationTick++;
 
 	if (playerDead) {
 		// Step the physics forwards
-		physicsWorld->Step(1.0 / (float)REFRESH_RATE, 8, 3);
+		stepPhysics();
 		return;
 	}
 
-	// We only want to draw if the game isn't displaying any popups
-	if (paused == true || displayAreYouSure == true) return;
-
 	b2Vec2 velocity = playerBody->GetLinearVelocity();
 
 	// If the player is on a ladder we can turn off gravity
@@ -430,9 +543,9 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 
 	// If the player pressed space then we can apply a jump impulse, but only if they are on the gorund.
 	// We also need to make sure that enough time has passed to stop the player spam jumping.
-	else if ((keyStateByte & 1) && collisionListener->playerGroundContacts > 0 && SDL_GetTicks() - playerJumpStartTime >= 200) {
+	else if ((keyStateByte & 1) && collisionListener->playerGroundContacts > 0 && simulationTick - playerJumpStartTick >= JUMP_COOLDOWN_TICKS) {
 		playerBody->ApplyLinearImpulseToCenter(b2Vec2(0.0, 10.0), true);
-		playerJumpStartTime = SDL_GetTicks();
+		playerJumpStartTick = simulationTick;
 	}
 
 	// This stuff is for moving the player
@@ -455,7 +568,7 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 		underfootFixture->GetBody()->ApplyLinearImpulse(b2Vec2(-1 * leftRightImpulse.x / 13, 0), locationOfImpulseInWorldCoords, true);
 
 	// Update the moving platforms
-	maps[currentLevel].doMovingPlatformLogic(collisionListener->buttons);
+	maps[currentLevel].doMovingPlatformLogic(collisionListener->buttons, SIMULATION_TIMESTEP);
 
 	// This is to stop the player sliding off of a moving platform
 	if (collisionListener->movingPlatforms.size() > 0)
@@ -466,15 +579,11 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 		// We need to delete all of the physics for the level and switch to the new level
 		currentLevel = collisionListener->levelEntranceNum;
 		writeUserData();
-		createPhysics();
-		maps[currentLevel].createHitboxes(physicsWorld);
+		startLevel(currentLevel);
 	}
 
 	// Step the physics forwards
-	physicsWorld->Step(1.0 / (float)REFRESH_RATE, 8, 3);
-
-	// Check if any map scrolling is needed
-	checkScrolling();
+	stepPhysics();
 
 	// The parameters to this function hold whether the movement states are the same or not. For param #1, we are getting the states of the left and right keys.
 	// When you bitwise & them with 4 and 8, they return 4 and 8 if those keys/buttons are being pressed. We then add them together to see if they are bigger
@@ -505,13 +614,18 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 			particleDef.position.Set(p.x, p.y);
 			b2Body* particleBody = physicsWorld->CreateBody(&particleDef);
 
-			DeathParticle particle = {particleBody, (char)(rand() % 16)};
+			DeathParticle particle = {particleBody, (char)(rand() % 16), particleBody->GetPosition(), 0};
 			deathParticles.push_back(particle);
 
 			b2PolygonShape particleShape;
 			// The hitbox should be a bit smaller than the actual rendered particle since box2d collides with polygon skins instead of the polygon surface
 			particleShape.SetAsBox(0.1, 0.1);
-			particleBody->CreateFixture(&particleShape, 1.0);
+			b2FixtureDef particleFixtureDef;
+			particleFixtureDef.shape = &particleShape;
+			particleFixtureDef.density = 1.0;
+			particleFixtureDef.userData = &particleTag;
+			particleFixtureDef.filter = getFixtureFilter(FixtureKind::PARTICLE);
+			particleBody->CreateFixture(&particleFixtureDef);
 
 			particleBody->ApplyLinearImpulseToCenter(b2Vec2((rand() % 2) / 2.0, (rand() % 2) / 2.0), true);
 		}
@@ -529,13 +643,14 @@ void Platformer::gameScreenLoop(bool pendingMouseEvent, bool pendingKeyEvent) {
 		camYOffset = 0;
 
 		// We need to delete all of the physics for the level and switch to the new level
-		createPhysics();
-		maps[currentLevel].createHitboxes(physicsWorld);
+		startLevel(currentLevel);
 	}
 }
 
 // CREDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDits
 void Platformer::creditsScreenLoop(bool pendingMouseEvent) {
+	PROFILE_FUNCTION();
+
 	if (!muted)
 		audioHandler.checkForTrackEnd();
 
@@ -595,7 +710,8 @@ void Platformer::creditsScreenLoop(bool pendingMouseEvent) {
 	#endif
 
 	fontHandler->renderFont("button_font", "Main menu", 100, SCREEN_HEIGHT - 50);
-	SDL_RenderPresent(renderer);
+	// Draw whatever is left in the sprite batch before showing everything
+	presentFrame();
 
 	#ifdef MOBILE
 	if (pendingMouseEvent) {
@@ -608,6 +724,8 @@ void Platformer::creditsScreenLoop(bool pendingMouseEvent) {
 
 // How to play
 void Platformer::instructionsScreenLoop(bool pendingMouseEvent) {
+	PROFILE_FUNCTION();
+
 	if (!muted)
 		audioHandler.checkForTrackEnd();
 
@@ -686,21 +804,22 @@ good luck!", SCREEN_WIDTH / 2, 350);
 	fontHandler->renderFont("button_font", "Main menu", 100, SCREEN_HEIGHT - 50);
 
 	// These lines render a 64x64 block of lava next to the 'dont touch the lava' line
-	SDL_Rect sourceRectangle = {64, 0, 32, 64};
+	SDL_Rect sourceRectangle = menuSprites.getSourceRect(64, 0, 32, 64);
 	rectangle = {SCREEN_WIDTH / 2 + 160, 315, 32, 64};
-	SDL_RenderCopy(renderer, menuSprites, &sourceRectangle, &rectangle);
+	spriteBatch.draw(menuSprites.texture, &sourceRectangle, &rectangle);
 	rectangle.x += 32;
-	SDL_RenderCopy(renderer, menuSprites, &sourceRectangle, &rectangle);
+	spriteBatch.draw(menuSprites.texture, &sourceRectangle, &rectangle);
 
 	// This renders the squish monster
-	sourceRectangle = {0, 64, 32, 32};
+	sourceRectangle = menuSprites.getSourceRect(0, 64, 32, 32);
 	rectangle = { SCREEN_WIDTH / 2 + 180, 370, 32, 32 };
-	SDL_RenderCopy(renderer, menuSprites, &sourceRectangle, &rectangle);
+	spriteBatch.draw(menuSprites.texture, &sourceRectangle, &rectangle);
 
 	// Finally, this renders the level end portal
-	sourceRectangle = {0, 0, 64, 64};
+	sourceRectangle = menuSprites.getSourceRect(0, 0, 64, 64);
 	rectangle = { SCREEN_WIDTH / 2 + 250, 430, 64, 64 };
-	SDL_RenderCopy(renderer, menuSprites, &sourceRectangle, &rectangle);
+	spriteBatch.draw(menuSprites.texture, &sourceRectangle, &rectangle);
 
-	SDL_RenderPresent(renderer);
+	// Draw whatever is left in the sprite batch before showing everything
+	presentFrame();
 }
\ No newline at end of file
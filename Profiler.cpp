@@ -0,0 +1,152 @@
+#include "Profiler.h"
+
+#ifdef PLATFORMER_PROFILING
+
+atomic<Profiler::ThreadBuffer*> Profiler::threadBuffers(NULL);
+thread_local Profiler::ThreadBuffer* Profiler::currentThreadBuffer = NULL;
+
+void Profiler::recordZone(const char* name, Uint64 startTime, Uint64 endTime) {
+	ThreadBuffer* buffer = getThreadBuffer();
+	Block* block = buffer->currentBlock;
+
+	int count = block->count.load(memory_order_relaxed);
+	if (count == PROFILER_BLOCK_SIZE) {
+		Block* newBlock = createBlock();
+		block->next.store(newBlock, memory_order_release);
+		buffer->currentBlock = newBlock;
+		block = newBlock;
+		count = 0;
+	}
+
+	block->zones[count] = { name, startTime, endTime };
+	// Release makes sure the zone is written before the trace writer can see the new count
+	block->count.store(count + 1, memory_order_release);
+}
+
+void Profiler::setThreadName(const char* name) {
+	getThreadBuffer()->threadName = name;
+}
+
+Profiler::ThreadBuffer* Profiler::getThreadBuffer() {
+	if (currentThreadBuffer != NULL) return currentThreadBuffer;
+
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->threadID = SDL_ThreadID();
+	buffer->threadName = NULL;
+	buffer->firstBlock = createBlock();
+	buffer->currentBlock = buffer->firstBlock;
+
+	// Push the buffer onto the front of the list. If another thread got there first then we just try again with the new front
+	buffer->next = threadBuffers.load(memory_order_relaxed);
+	while (!threadBuffers.compare_exchange_weak(buffer->next, buffer, memory_order_release, memory_order_relaxed)) {}
+
+	currentThreadBuffer = buffer;
+	return buffer;
+}
+
+Profiler::Block* Profiler::createBlock() {
+	Block* block = new Block();
+	block->count.store(0, memory_order_relaxed);
+	block->next.store(NULL, memory_order_relaxed);
+	return block;
+}
+
+// Zone names are usually plain function names, but quotes and backslashes would break the JSON
+static string escapeJSON(const char* text) {
+	string escaped;
+	for (const char* c = text; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') escaped += '\\';
+		escaped += *c;
+	}
+	return escaped;
+}
+
+bool Profiler::writeTrace(string filename) {
+	SDL_RWops* file = SDL_RWFromFile(filename.c_str(), "w");
+	if (file == NULL) {
+		SDL_Log("Couldn't open %s for the profiler trace. Error: %s", filename.c_str(), SDL_GetError());
+		return false;
+	}
+
+	// Chrome traces use microseconds
+	double counterToMicroseconds = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+
+	// The trace starts when the earliest zone started. Zones are only recorded when they finish, so the first zone recorded is usually inside
+	// ones that started before it (like loadAssets around the fonts it loads)
+	Uint64 traceStartTime = 0;
+	bool foundZone = false;
+	for (ThreadBuffer* buffer = threadBuffers.load(memory_order_acquire); buffer != NULL; buffer = buffer->next) {
+		for (Block* block = buffer->firstBlock; block != NULL; block = block->next.load(memory_order_acquire)) {
+			int count = block->count.load(memory_order_acquire);
+			for (int i = 0; i < count; i++) {
+				if (!foundZone || block->zones[i].startTime < traceStartTime)
+					traceStartTime = block->zones[i].startTime;
+				foundZone = true;
+			}
+		}
+	}
+
+	string header = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	SDL_RWwrite(file, header.c_str(), 1, header.size());
+
+	bool firstEvent = true;
+	unsigned long zoneCount = 0;
+	char eventText[128];
+
+	for (ThreadBuffer* buffer = threadBuffers.load(memory_order_acquire); buffer != NULL; buffer = buffer->next) {
+		string events;
+
+		// A metadata event gives the thread a name in the timeline
+		if (buffer->threadName != NULL) {
+			events += firstEvent ? "" : ",\n";
+			events += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + to_string(buffer->threadID) + ",\"args\":{\"name\":\"" + escapeJSON(buffer->threadName) + "\"}}";
+			firstEvent = false;
+		}
+
+		for (Block* block = buffer->firstBlock; block != NULL; block = block->next.load(memory_order_acquire)) {
+			int count = block->count.load(memory_order_acquire);
+
+			for (int i = 0; i < count; i++) {
+				Zone& zone = block->zones[i];
+
+				// Complete events ("X") have a start and a duration, so each zone is only one event
+				snprintf(eventText, sizeof(eventText), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}", (unsigned long)buffer->threadID,
+					((Sint64)zone.startTime - (Sint64)traceStartTime) * counterToMicroseconds, ((Sint64)zone.endTime - (Sint64)zone.startTime) * counterToMicroseconds);
+
+				events += firstEvent ? "" : ",\n";
+				events += "{\"name\":\"" + escapeJSON(zone.name) + eventText;
+				firstEvent = false;
+				zoneCount++;
+			}
+		}
+
+		SDL_RWwrite(file, events.c_str(), 1, events.size());
+	}
+
+	string footer = "\n]}\n";
+	SDL_RWwrite(file, footer.c_str(), 1, footer.size());
+	SDL_RWclose(file);
+
+	SDL_Log("Wrote %lu profiler zones to %s", zoneCount, filename.c_str());
+	return true;
+}
+
+void Profiler::shutdown() {
+	ThreadBuffer* buffer = threadBuffers.exchange(NULL);
+	while (buffer != NULL) {
+		Block* block = buffer->firstBlock;
+		while (block != NULL) {
+			Block* nextBlock = block->next.load();
+			delete block;
+			block = nextBlock;
+		}
+
+		ThreadBuffer* nextBuffer = buffer->next;
+		delete buffer;
+		buffer = nextBuffer;
+	}
+
+	currentThreadBuffer = NULL;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+// The profiler records scoped zones (a name, a start time and an end time) and writes them out as a Chrome trace, which can be opened in
+// Perfetto (ui.perfetto.dev) or chrome://tracing to see a timeline of every frame. It is only compiled in when PLATFORMER_PROFILING is defined
+// (add it to the preprocessor definitions in the project settings), otherwise all of the macros below turn into nothing.
+//
+// Put PROFILE_ZONE("name") or PROFILE_FUNCTION() at the top of a block and the zone lasts until the end of the block. The name has to be a
+// string that lives forever (like a string literal) because only the pointer is stored.
+
+#ifdef PLATFORMER_PROFILING
+
+#include <atomic>
+#include <string>
+
+#include <SDL.h>
+
+using namespace std;
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD_NAME(name) Profiler::setThreadName(name)
+
+// How many zones fit in each block of a thread's buffer
+#define PROFILER_BLOCK_SIZE 4096
+
+class Profiler
+{
+public:
+	// Adds a finished zone to the calling thread's buffer. The times are performance counter values
+	static void recordZone(const char* name, Uint64 startTime, Uint64 endTime);
+	// Names the calling thread in the trace
+	static void setThreadName(const char* name);
+
+	// Writes every zone from every thread to a Chrome trace JSON file. This should only be called once the other threads have stopped recording
+	static bool writeTrace(string filename);
+	// Frees all of the buffers. Nothing can be recorded after this
+	static void shutdown();
+
+private:
+	struct Zone {
+		const char* name;
+		Uint64 startTime;
+		Uint64 endTime;
+	};
+
+	// Every thread writes its zones into its own chain of blocks, so recording never needs a lock. The count is only increased after a zone is
+	// written, and a new block is only linked in after it has been made, so the trace writer can read a block while its thread is still adding to it
+	struct Block {
+		Zone zones[PROFILER_BLOCK_SIZE];
+		atomic<int> count;
+		atomic<Block*> next;
+	};
+
+	struct ThreadBuffer {
+		SDL_threadID threadID;
+		const char* threadName;
+		Block* firstBlock;
+		// Only ever used by the thread that owns the buffer
+		Block* currentBlock;
+		// The buffers are kept in a linked list so the trace writer can find all of them
+		ThreadBuffer* next;
+	};
+
+	static ThreadBuffer* getThreadBuffer();
+	static Block* createBlock();
+
+	static atomic<ThreadBuffer*> threadBuffers;
+	// Each thread finds its own buffer through this, so there's no searching or locking when a zone is recorded
+	static thread_local ThreadBuffer* currentThreadBuffer;
+};
+
+// Records the time it was made and the time it was destroyed as a zone
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name) {
+		this->name = name;
+		startTime = SDL_GetPerformanceCounter();
+	}
+
+	~ProfileZone() {
+		Profiler::recordZone(name, startTime, SDL_GetPerformanceCounter());
+	}
+
+private:
+	const char* name;
+	Uint64 startTime;
+};
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD_NAME(name)
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// A set for the handful of things the player is touching at once, like the platforms and entities under their feet. std::set allocates a node for
+// every insert, and contacts begin and end all the time, so that would be lots of tiny allocations every step. This keeps the items in a plain array
+// inside the object and only goes to the heap if there are more than InlineCapacity of them. Once it has grown it keeps the space, so clearing it
+// and filling it again doesn't allocate either. The order of the items isn't kept when one is erased
+template <typename T, int InlineCapacity>
+class SmallSet {
+public:
+	SmallSet() {}
+	// items points into the object itself, so copying it would leave the copy pointing at the original
+	SmallSet(const SmallSet&) = delete;
+	SmallSet& operator=(const SmallSet&) = delete;
+
+	// Returns false if the item was already in the set
+	bool insert(T item) {
+		if (contains(item)) return false;
+		if (count == capacity) grow();
+		items[count++] = item;
+		return true;
+	}
+
+	// Returns false if the item wasn't in the set. The last item is moved into the gap so nothing needs to be shifted along
+	bool erase(T item) {
+		for (int i = 0; i < count; i++) {
+			if (items[i] == item) {
+				items[i] = items[--count];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool contains(T item) const {
+		return find(items, items + count, item) != items + count;
+	}
+
+	void clear() { count = 0; }
+	int size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+
+private:
+	T inlineItems[InlineCapacity];
+	vector<T> heapItems;
+	T* items = inlineItems;
+	int count = 0;
+	int capacity = InlineCapacity;
+
+	void grow() {
+		vector<T> grownItems(capacity * 2);
+		copy(items, items + count, grownItems.begin());
+		heapItems.swap(grownItems);
+		items = heapItems.data();
+		capacity *= 2;
+	}
+};
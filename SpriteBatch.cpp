@@ -0,0 +1,92 @@
+#include "SpriteBatch.h"
+
+SpriteBatch::SpriteBatch() {}
+
+SpriteBatch::SpriteBatch(SDL_Renderer* ren) {
+	renderer = ren;
+}
+
+void SpriteBatch::draw(SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_Rect* destinationRect, double angle, SDL_RendererFlip flip) {
+	if (texture == NULL) return;
+
+	// A different texture means a different draw call, so everything before this sprite needs to be drawn first
+	if (texture != currentTexture) {
+		flush();
+		currentTexture = texture;
+		SDL_QueryTexture(texture, NULL, NULL, &textureWidth, &textureHeight);
+	}
+
+	// A NULL source rect means the whole texture, same as SDL_RenderCopy
+	SDL_Rect source = sourceRect != NULL ? *sourceRect : SDL_Rect{ 0, 0, textureWidth, textureHeight };
+
+	spriteCount++;
+
+	#if SDL_VERSION_ATLEAST(2, 0, 18)
+	// Texture coordinates go from 0 to 1. A horizontal flip just swaps the left and right coordinates
+	float u0 = (float)source.x / textureWidth;
+	float u1 = (float)(source.x + source.w) / textureWidth;
+	float v0 = (float)source.y / textureHeight;
+	float v1 = (float)(source.y + source.h) / textureHeight;
+	if (flip & SDL_FLIP_HORIZONTAL) swap(u0, u1);
+	if (flip & SDL_FLIP_VERTICAL) swap(v0, v1);
+
+	// The corners of the sprite relative to its center, in the order top left, top right, bottom right, bottom left
+	float halfWidth = destinationRect->w / 2.0f;
+	float halfHeight = destinationRect->h / 2.0f;
+	float centerX = destinationRect->x + halfWidth;
+	float centerY = destinationRect->y + halfHeight;
+	float cornersX[4] = { -halfWidth, halfWidth, halfWidth, -halfWidth };
+	float cornersY[4] = { -halfHeight, -halfHeight, halfHeight, halfHeight };
+	float cornersU[4] = { u0, u1, u1, u0 };
+	float cornersV[4] = { v0, v0, v1, v1 };
+
+	// Only do the trig if we actually need to rotate the sprite. The y axis points down on the screen, so this rotates the sprite clockwise like SDL_RenderCopyEx
+	float sinAngle = 0.0f;
+	float cosAngle = 1.0f;
+	if (angle != 0.0) {
+		sinAngle = (float)sin(angle * M_PI / 180.0);
+		cosAngle = (float)cos(angle * M_PI / 180.0);
+	}
+
+	int firstVertex = (int)vertices.size();
+	for (int i = 0; i < 4; i++) {
+		SDL_Vertex vertex;
+		vertex.position.x = centerX + cornersX[i] * cosAngle - cornersY[i] * sinAngle;
+		vertex.position.y = centerY + cornersX[i] * sinAngle + cornersY[i] * cosAngle;
+		vertex.color = { 255, 255, 255, 255 };
+		vertex.tex_coord.x = cornersU[i];
+		vertex.tex_coord.y = cornersV[i];
+		vertices.push_back(vertex);
+	}
+
+	// Two triangles make up the quad
+	int quadIndices[6] = { 0, 1, 2, 2, 3, 0 };
+	for (int i = 0; i < 6; i++)
+		indices.push_back(firstVertex + quadIndices[i]);
+	#else
+	QueuedSprite sprite = { source, { (float)destinationRect->x, (float)destinationRect->y, (float)destinationRect->w, (float)destinationRect->h }, angle, flip };
+	queuedSprites.push_back(sprite);
+	#endif
+}
+
+void SpriteBatch::flush() {
+	#if SDL_VERSION_ATLEAST(2, 0, 18)
+	if (!vertices.empty()) {
+		SDL_RenderGeometry(renderer, currentTexture, vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+		drawCallCount++;
+	}
+
+	// Clearing the vectors keeps their memory, so we aren't allocating every frame
+	vertices.clear();
+	indices.clear();
+	#else
+	// Without SDL_RenderGeometry every sprite is still its own draw call, so there's no saving to count
+	for (QueuedSprite& sprite : queuedSprites)
+		SDL_RenderCopyExF(renderer, currentTexture, &sprite.sourceRect, &sprite.destinationRect, sprite.angle, NULL, sprite.flip);
+
+	queuedSprites.clear();
+	#endif
+
+	// The next sprite will start a new batch
+	currentTexture = NULL;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+
+#include <SDL.h>
+
+using namespace std;
+
+// The sprite batch collects textured quads and submits all of the quads that share a texture with a single draw call. Sprites are drawn in the
+// order they were added, so a batch is only broken up when the texture changes. Anything that isn't drawn through the batch (like the rectangles
+// for buttons and the box2d debug drawing) needs the batch to be flushed first, otherwise the sprites would end up being drawn on top of it.
+class SpriteBatch
+{
+public:
+	SpriteBatch();
+	SpriteBatch(SDL_Renderer* ren);
+
+	// Adds a sprite to the batch. The parameters are the same as SDL_RenderCopyEx, so a NULL source rect means the whole texture.
+	// The angle is in degrees clockwise and the sprite is rotated around its center
+	void draw(SDL_Texture* texture, const SDL_Rect* sourceRect, const SDL_Rect* destinationRect, double angle = 0.0, SDL_RendererFlip flip = SDL_FLIP_NONE);
+	// Draws everything that has been added to the batch
+	void flush();
+
+	// These count how many sprites were drawn and how many draw calls that took. Before batching every sprite was its own draw call,
+	// so the sprite count is what the draw call count used to be. The draw calls are only counted when SDL is new enough to have
+	// SDL_RenderGeometry, since the fallback doesn't batch anything
+	unsigned long spriteCount = 0;
+	unsigned long drawCallCount = 0;
+
+private:
+	SDL_Renderer* renderer = NULL;
+
+	// The texture of the current batch. When a sprite with a different texture is drawn, the current batch is flushed first
+	SDL_Texture* currentTexture = NULL;
+	// The size of the current texture. Needed for turning the source rects into texture coordinates
+	int textureWidth = 0;
+	int textureHeight = 0;
+
+	#if SDL_VERSION_ATLEAST(2, 0, 18)
+	// Every sprite is a quad made out of 4 vertices and 2 triangles
+	vector<SDL_Vertex> vertices;
+	vector<int> indices;
+	#else
+	// Older versions of SDL don't have SDL_RenderGeometry, so the sprites are kept and drawn one at a time when the batch is flushed.
+	// SDL still groups these copies together internally as long as render batching is on
+	struct QueuedSprite {
+		SDL_Rect sourceRect;
+		SDL_FRect destinationRect;
+		double angle;
+		SDL_RendererFlip flip;
+	};
+	vector<QueuedSprite> queuedSprites;
+	#endif
+};
@@ -0,0 +1,285 @@
+#include "TextureAtlas.h"
+
+TextureAtlas::TextureAtlas() {}
+
+TextureAtlas::TextureAtlas(SDL_Renderer* ren) {
+	renderer = ren;
+	imagesMutex = SDL_CreateMutex();
+
+	// Some renderers (especially on phones) can't make textures as big as the default page size
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0 && info.max_texture_height > 0)
+		pageSize = min(pageSize, min(info.max_texture_width, info.max_texture_height));
+}
+
+void TextureAtlas::destroy() {
+	for (Page& page : pages) {
+		SDL_DestroyTexture(page.texture);
+		page.texture = NULL;
+	}
+
+	pages.clear();
+
+	// Nothing can be looking for images once the atlas is destroyed
+	images.clear();
+	SDL_DestroyMutex(imagesMutex);
+	imagesMutex = NULL;
+}
+
+string TextureAtlas::normalizeImageName(string name) {
+	// Windows paths can use either slash
+	replace(name.begin(), name.end(), '\\', '/');
+
+	// Split the path into its parts, dropping "." parts and letting ".." parts cancel out the part before them
+	vector<string> parts;
+	size_t partStart = 0;
+	while (partStart <= name.size()) {
+		size_t partEnd = name.find('/', partStart);
+		if (partEnd == string::npos) partEnd = name.size();
+		string part = name.substr(partStart, partEnd - partStart);
+
+		if (part == ".." && !parts.empty() && parts.back() != "..")
+			parts.pop_back();
+		else if (part != "." && !(part.empty() && !parts.empty()))
+			parts.push_back(part);
+
+		partStart = partEnd + 1;
+	}
+
+	string normalizedName;
+	for (int i = 0; i < parts.size(); i++) {
+		if (i > 0) normalizedName += '/';
+		normalizedName += parts[i];
+	}
+	return normalizedName;
+}
+
+bool TextureAtlas::acquireExistingImage(const string& name, AtlasRegion* region) {
+	auto existingImage = images.find(name);
+	if (existingImage == images.end()) return false;
+
+	existingImage->second.references++;
+	*region = existingImage->second.region;
+	return true;
+}
+
+bool TextureAtlas::addImage(string filename, AtlasRegion* region) {
+	filename = normalizeImageName(filename);
+
+	// Images that are used by more than one thing (like a tileset that a few levels use) only need to be packed once
+	if (acquireExistingImage(filename, region))
+		return true;
+
+	SDL_Surface* surface = IMG_Load(filename.c_str());
+	if (surface == NULL) {
+		SDL_Log("Couldn't load image %s for the atlas. SDL_image Error: %s", filename.c_str(), IMG_GetError());
+		return false;
+	}
+
+	bool result = addSurface(filename, surface, region);
+	SDL_FreeSurface(surface);
+
+	return result;
+}
+
+bool TextureAtlas::addImages(const vector<string>& filenames, vector<AtlasRegion>* regionsOut) {
+	// Load all of the images first so we know how big they are
+	vector<string> names(filenames.size());
+	vector<SDL_Surface*> surfaces(filenames.size(), NULL);
+	for (int i = 0; i < filenames.size(); i++) {
+		names[i] = normalizeImageName(filenames[i]);
+		if (images.count(names[i]) > 0) continue;
+
+		surfaces[i] = IMG_Load(names[i].c_str());
+		if (surfaces[i] == NULL)
+			SDL_Log("Couldn't load image %s for the atlas. SDL_image Error: %s", names[i].c_str(), IMG_GetError());
+	}
+
+	bool result = addSurfaces(names, surfaces, regionsOut);
+
+	for (SDL_Surface* surface : surfaces)
+		SDL_FreeSurface(surface);
+
+	return result;
+}
+
+bool TextureAtlas::addSurfaces(const vector<string>& names, const vector<SDL_Surface*>& surfaces, vector<AtlasRegion>* regionsOut) {
+	regionsOut->resize(names.size());
+
+	// Shelves waste the least space when the tallest images go in first
+	vector<int> order(names.size());
+	for (int i = 0; i < order.size(); i++) order[i] = i;
+	sort(order.begin(), order.end(), [&surfaces](int a, int b) {
+		int heightA = surfaces[a] != NULL ? surfaces[a]->h : 0;
+		int heightB = surfaces[b] != NULL ? surfaces[b]->h : 0;
+		return heightA > heightB;
+	});
+
+	bool result = true;
+	for (int i : order) {
+		// The image was already in the atlas
+		if (surfaces[i] == NULL && acquireExistingImage(names[i], &(*regionsOut)[i]))
+			continue;
+
+		if (surfaces[i] == NULL || !addSurface(names[i], surfaces[i], &(*regionsOut)[i]))
+			result = false;
+	}
+
+	return result;
+}
+
+bool TextureAtlas::hasImage(string name) {
+
+	SDL_LockMutex(imagesMutex);
+	bool found = images.count(name) > 0;
+	SDL_UnlockMutex(imagesMutex);
+
+	return found;
+}
+
+SDL_Surface* TextureAtlas::loadImage(string filename) {
+	filename = normalizeImageName(filename);
+
+	SDL_Surface* surface = IMG_Load(filename.c_str());
+	if (surface == NULL) {
+		SDL_Log("Couldn't load %s. SDL_image Error: %s", filename.c_str(), IMG_GetError());
+		return NULL;
+	}
+
+	if (surface->format->format == SDL_PIXELFORMAT_RGBA32)
+		return surface;
+
+	SDL_Surface* convertedSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+	SDL_FreeSurface(surface);
+	if (convertedSurface == NULL)
+		SDL_Log("Couldn't convert %s for the atlas. SDL Error: %s", filename.c_str(), SDL_GetError());
+
+	return convertedSurface;
+}
+
+bool TextureAtlas::addSurface(string name, SDL_Surface* surface, AtlasRegion* region) {
+	if (acquireExistingImage(name, region))
+		return true;
+
+	SDL_Rect rect;
+	int pageIndex = findSpace(surface->w, surface->h, &rect);
+	if (pageIndex == -1) {
+		SDL_Log("Couldn't find space in the atlas for %s", name.c_str());
+		return false;
+	}
+
+	// The pages use 32 bit RGBA pixels, so the image needs to be in the same format before it can be copied in. This also turns
+	// the colour key of rendered font characters into transparent pixels. Images from loadImage are already in the right format
+	if (surface->format->format == SDL_PIXELFORMAT_RGBA32) {
+		SDL_UpdateTexture(pages[pageIndex].texture, &rect, surface->pixels, surface->pitch);
+	}
+	else {
+		SDL_Surface* convertedSurface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+		if (convertedSurface == NULL) {
+			SDL_Log("Couldn't convert %s for the atlas. SDL Error: %s", name.c_str(), SDL_GetError());
+			return false;
+		}
+
+		SDL_UpdateTexture(pages[pageIndex].texture, &rect, convertedSurface->pixels, convertedSurface->pitch);
+		SDL_FreeSurface(convertedSurface);
+	}
+
+	region->texture = pages[pageIndex].texture;
+	region->rect = rect;
+	pages[pageIndex].imageCount++;
+
+	SDL_LockMutex(imagesMutex);
+	images.insert(make_pair(name, PackedImage{ *region, 1 }));
+	SDL_UnlockMutex(imagesMutex);
+
+	return true;
+}
+
+void TextureAtlas::releaseImage(string name) {
+
+	// Releasing an image that isn't there is fine, since the atlas might have already been destroyed
+	auto image = images.find(name);
+	if (image == images.end()) return;
+
+	image->second.references--;
+	if (image->second.references > 0) return;
+
+	SDL_Texture* pageTexture = image->second.region.texture;
+	SDL_LockMutex(imagesMutex);
+	images.erase(image);
+	SDL_UnlockMutex(imagesMutex);
+
+	// The shelves can't reuse the space of a single image, but once nothing is left in a page the whole page can be given back
+	for (int i = 0; i < pages.size(); i++) {
+		if (pages[i].texture != pageTexture) continue;
+
+		pages[i].imageCount--;
+		if (pages[i].imageCount == 0) {
+			SDL_Log("Freed atlas page %d (%dx%d)", i, pages[i].width, pages[i].height);
+			SDL_DestroyTexture(pages[i].texture);
+			pages.erase(pages.begin() + i);
+		}
+		break;
+	}
+}
+
+int TextureAtlas::findSpace(int width, int height, SDL_Rect* outputRect) {
+	int paddedWidth = width + ATLAS_PADDING;
+	int paddedHeight = height + ATLAS_PADDING;
+
+	for (int i = 0; i < pages.size(); i++) {
+		Page& page = pages[i];
+
+		// Work out where the image would go first and only change the page once we know it fits. Otherwise a big image that doesn't fit would
+		// still close the current shelf, and the space left on it would be wasted for the smaller images that come after
+		int x = page.cursorX;
+		int y = page.shelfY;
+		int shelfHeight = page.shelfHeight;
+
+		// Start a new shelf if the image doesn't fit on the end of the current one
+		if (x + paddedWidth > page.width) {
+			y += shelfHeight;
+			shelfHeight = 0;
+			x = 0;
+		}
+
+		// If the image still doesn't fit then this page is full (for this image at least)
+		if (x + paddedWidth > page.width || y + paddedHeight > page.height)
+			continue;
+
+		*outputRect = { x, y, width, height };
+		page.cursorX = x + paddedWidth;
+		page.shelfY = y;
+		page.shelfHeight = max(shelfHeight, paddedHeight);
+		return i;
+	}
+
+	// None of the pages had space, so we need a new one. Images that are bigger than a page get a page of their own
+	int pageIndex = createPage(max(pageSize, paddedWidth), max(pageSize, paddedHeight));
+	if (pageIndex == -1) return -1;
+
+	Page& page = pages[pageIndex];
+	*outputRect = { 0, 0, width, height };
+	page.cursorX = paddedWidth;
+	page.shelfHeight = paddedHeight;
+	return pageIndex;
+}
+
+int TextureAtlas::createPage(int width, int height) {
+	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, width, height);
+	if (texture == NULL) {
+		SDL_Log("Couldn't create an atlas page. SDL Error: %s", SDL_GetError());
+		return -1;
+	}
+
+	// The empty parts of the page need to be transparent, but a new texture can have anything in it
+	vector<Uint32> emptyPixels(width * height, 0);
+	SDL_UpdateTexture(texture, NULL, emptyPixels.data(), width * sizeof(Uint32));
+	SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+	Page page = { texture, width, height, 0, 0, 0, 0 };
+	pages.push_back(page);
+
+	SDL_Log("Created atlas page %d (%dx%d)", (int)pages.size() - 1, width, height);
+	return (int)pages.size() - 1;
+}
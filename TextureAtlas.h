@@ -0,0 +1,100 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+using namespace std;
+
+// The space left between images in an atlas page, so that a sprite never picks up the edge of the image next to it
+#define ATLAS_PADDING 1
+
+// Where an image ended up after it was packed into the atlas. The texture is the atlas page that the image is in, and the rect is the
+// part of the page that has the image
+struct AtlasRegion {
+	SDL_Texture* texture = NULL;
+	SDL_Rect rect = { 0, 0, 0, 0 };
+
+	// Turns a source rect that was made for the original image into a source rect for the atlas page
+	SDL_Rect getSourceRect(int x, int y, int w, int h) const { return { rect.x + x, rect.y + y, w, h }; }
+};
+
+// The texture atlas packs lots of small images into a few big textures (pages). Sprites from the same page can then be drawn with a single draw call
+// by the sprite batch. Images are packed into rows (shelves) from the top left of the page, and a new page is made when a page is full.
+class TextureAtlas
+{
+public:
+	TextureAtlas();
+	TextureAtlas(SDL_Renderer* ren);
+	// Destroys all of the pages. This needs to be done before the renderer is destroyed
+	void destroy();
+
+	// Images are shared by everything that uses them, and are kept track of with a reference count. Every successful add (including adding an image
+	// that was already packed) adds a reference, and releaseImage() takes one away. An image is removed once nothing references it, and a page is
+	// destroyed once all of its images are gone. The file names given to addImage() and addImages() are normalized so that
+	// "maps/../spritesheet.png" and "spritesheet.png" are the same image. Images are always looked up by their normalized name, so anything
+	// that packs a loaded file with addSurface() should name it with normalizeImageName() too
+
+	// Loads an image file and packs it into the atlas. If the file was already packed then the region it was packed into is returned straight away
+	bool addImage(string filename, AtlasRegion* region);
+	// Loads a group of images and packs the tallest ones first, which wastes less space than packing them in any order
+	bool addImages(const vector<string>& filenames, vector<AtlasRegion>* regions);
+	// Packs an image that has already been loaded, like a rendered font character. The surface isn't freed
+	bool addSurface(string name, SDL_Surface* surface, AtlasRegion* region);
+	// Packs a group of images that have already been loaded, tallest first. A NULL surface is fine if the image is already in the atlas. The surfaces aren't freed
+	bool addSurfaces(const vector<string>& names, const vector<SDL_Surface*>& surfaces, vector<AtlasRegion>* regions);
+	// Gives back a reference to an image. Releasing an image that isn't in the atlas does nothing
+	void releaseImage(string name);
+
+	// Returns true if an image with this name has already been packed. This can be called from a loading thread to skip decoding images that are
+	// already packed, but the image could be released before the main thread gets to it, so the main thread still needs to add it
+	bool hasImage(string name);
+	// Loads an image and converts it to the format of the atlas pages, so that packing it later is just a copy. This doesn't touch the atlas
+	// or the renderer, so it is safe to call from a loading thread. Returns NULL if the image couldn't be loaded
+	static SDL_Surface* loadImage(string filename);
+	// Turns backslashes into slashes and takes out "." and ".." parts, so the same file always has the same name
+	static string normalizeImageName(string name);
+
+	int getPageCount() { return (int)pages.size(); }
+
+private:
+	struct Page {
+		SDL_Texture* texture;
+		int width;
+		int height;
+
+		// The top of the current shelf, how tall it is so far and how far along it the next image goes
+		int shelfY;
+		int shelfHeight;
+		int cursorX;
+
+		// How many images are still in the page. The page is destroyed when this gets to 0
+		int imageCount;
+	};
+
+	struct PackedImage {
+		AtlasRegion region;
+		int references;
+	};
+
+	SDL_Renderer* renderer = NULL;
+	// The size of a new page. This is lowered if the renderer can't make textures this big
+	int pageSize = 2048;
+
+	vector<Page> pages;
+	// All of the images that have been packed, so the same image is never packed twice. Only the main thread changes this, but hasImage() can be
+	// called from other threads, so it is locked while it is changed
+	unordered_map<string, PackedImage> images;
+	SDL_mutex* imagesMutex = NULL;
+
+	// Adds a reference to an image that is already packed. Returns false if it isn't packed
+	bool acquireExistingImage(const string& name, AtlasRegion* region);
+
+	// Finds a place in a page for an image of the given size, making a new page if needed. Returns the index of the page or -1 if a page couldn't be made
+	int findSpace(int width, int height, SDL_Rect* outputRect);
+	int createPage(int width, int height);
+};
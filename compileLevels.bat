@@ -0,0 +1 @@
+x64\Debug\LevelCompiler.exe "resources/maps/level 0.tmx" "resources/maps/level 1.tmx" "resources/maps/level 2.tmx" "resources/maps/level 3.tmx"
\ No newline at end of file
@@ -5,6 +5,12 @@
 
 int main(int argc, char* args[]) {
 	Platformer platformer;
+	platformer.parseArguments(argc, args);
+
+	if (platformer.benchmarkContacts) {
+		runContactBenchmark();
+		return 0;
+	}
 
 	bool result = platformer.init();
 	if (result == false) {